@@ -0,0 +1,144 @@
+/**
+ * Benchmark of the terminal core on the host.
+ *
+ * Replays captured UART streams through the parser, serializing
+ * an update after every few hundred bytes like a connected browser
+ * would receive them, and reports the throughput of both stages.
+ *
+ * Usage: bench [options] stream...
+ */
+
+#include <esp8266.h>
+#include <getopt.h>
+#include <time.h>
+#include "host.h"
+
+/** Options */
+static size_t opt_chunk = 64;
+static size_t opt_frame = 256;
+static int opt_repeat = 1;
+static int opt_width = 80, opt_height = 25;
+static ScreenNotifyTopics opt_flags = 0;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+
+	size_t cap = 65536;
+	char *buf = malloc(cap);
+	*len = 0;
+	size_t n;
+	while ((n = fread(buf + *len, 1, cap - *len, f)) > 0) {
+		*len += n;
+		if (*len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap);
+		}
+	}
+	fclose(f);
+	return buf;
+}
+
+static void bench_stream(const char *path)
+{
+	size_t len;
+	char *data = read_file(path, &len);
+	if (!data) return;
+
+	double t_parse = 0, t_seri = 0;
+	size_t frames = 0, seri_bytes = 0;
+
+	for (int r = 0; r < opt_repeat; r++) {
+		host_terminal_reset(opt_width, opt_height);
+		for (size_t i = 0; i < len; i += opt_frame) {
+			size_t n = (len - i < opt_frame) ? len - i : opt_frame;
+
+			double t0 = now();
+			host_feed(data + i, n, opt_chunk);
+			double t1 = now();
+			size_t out = host_frame(opt_flags, NULL, NULL);
+			double t2 = now();
+
+			t_parse += t1 - t0;
+			t_seri += t2 - t1;
+			if (out) {
+				frames++;
+				seri_bytes += out;
+			}
+		}
+	}
+
+	double total = (double) len * opt_repeat;
+	printf("%-24s %9zu B  parse %8.2f MB/s  %7zu frames  %10zu B out (%5.1f%%)  seri %8.2f MB/s  %8.0f frames/s\n",
+		   path, len,
+		   total / t_parse / 1e6,
+		   frames, seri_bytes,
+		   100.0 * (double) seri_bytes / total,
+		   (double) seri_bytes / t_seri / 1e6,
+		   (double) frames / t_seri);
+
+	free(data);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+			"Usage: %s [-c chunk] [-f bytes] [-n repeat] [-s WxH] [-b] stream...\n"
+			"  -c  bytes fed to the parser at once (default 64)\n"
+			"  -f  input bytes between serialized frames (default 256)\n"
+			"  -n  replay each stream N times (default 1)\n"
+			"  -s  screen size (default 80x25)\n"
+			"  -b  use the binary serialization format\n",
+			argv0);
+}
+
+int main(int argc, char **argv)
+{
+	int c;
+	while ((c = getopt(argc, argv, "c:f:n:s:bh")) != -1) {
+		switch (c) {
+			case 'c':
+				opt_chunk = (size_t) atoi(optarg);
+				break;
+			case 'f':
+				opt_frame = (size_t) atoi(optarg);
+				break;
+			case 'n':
+				opt_repeat = atoi(optarg);
+				break;
+			case 's':
+				if (sscanf(optarg, "%dx%d", &opt_width, &opt_height) != 2) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'b':
+				opt_flags |= TOPIC_FLAG_BINARY;
+				break;
+			default:
+				usage(argv[0]);
+				return c != 'h';
+		}
+	}
+
+	if (optind >= argc || opt_chunk == 0 || opt_frame == 0 || opt_repeat < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = optind; i < argc; i++) {
+		bench_stream(argv[i]);
+	}
+	return 0;
+}
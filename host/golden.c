@@ -0,0 +1,351 @@
+/**
+ * Golden-frame tests of the update serializer.
+ *
+ * Each case is a script of terminal input. It runs through the parser
+ * and the screen, and the serialized updates are compared with the
+ * golden file next to it, once in the text and once in the binary
+ * format. The golden files also record the size of every frame,
+ * so a change in the encoder's output size fails the check, too.
+ *
+ * Script commands, one per line:
+ *
+ *   # comment
+ *   size W H      - reset the terminal with this screen size (done with 80 25 at start)
+ *   feed TEXT     - input for the parser, with escapes \e \a \b \r \n \t \\ \xHH
+ *   repeat N TEXT - the same, N times
+ *   frame         - serialize the changes since the last frame
+ *   initial       - serialize the whole screen, as for a new client
+ *
+ * Usage: golden-tool [-u] case.txt...
+ *   -u  write the golden files instead of checking them
+ */
+
+#include <esp8266.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include "host.h"
+
+/** Line width of the escaped frame dump */
+#define DUMP_LINE_LEN 76
+
+/** Growing output buffer */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+} OutBuf;
+
+/** Totals of one format run */
+typedef struct {
+	int frames;
+	size_t bytes;
+} RunStats;
+
+/** Context of the frame callback */
+typedef struct {
+	OutBuf *out;
+	int msgs;
+	size_t col;
+} DumpCtx;
+
+static void out_write(OutBuf *ob, const char *s, size_t len)
+{
+	if (ob->len + len + 1 > ob->cap) {
+		while (ob->len + len + 1 > ob->cap) ob->cap = ob->cap ? ob->cap * 2 : 4096;
+		ob->data = realloc(ob->data, ob->cap);
+	}
+	memcpy(ob->data + ob->len, s, len);
+	ob->len += len;
+	ob->data[ob->len] = 0;
+}
+
+static void __attribute__((format(printf, 2, 3)))
+out_printf(OutBuf *ob, const char *fmt, ...)
+{
+	char tmp[256];
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+	va_end(ap);
+	out_write(ob, tmp, (size_t) n);
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) return NULL;
+
+	OutBuf ob = {0};
+	char tmp[4096];
+	size_t n;
+	while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) {
+		out_write(&ob, tmp, n);
+	}
+	fclose(f);
+	if (!ob.data) out_write(&ob, "", 0);
+	*len = ob.len;
+	return ob.data;
+}
+
+/** Decode the escapes of a feed argument in place, returns the length */
+static size_t unescape(char *s)
+{
+	char *w = s;
+	for (char *p = s; *p; p++) {
+		if (*p != '\\' || p[1] == 0) {
+			*w++ = *p;
+			continue;
+		}
+		p++;
+		switch (*p) {
+			case 'e': *w++ = '\033'; break;
+			case 'a': *w++ = '\a'; break;
+			case 'b': *w++ = '\b'; break;
+			case 'r': *w++ = '\r'; break;
+			case 'n': *w++ = '\n'; break;
+			case 't': *w++ = '\t'; break;
+			case 'x': {
+				char hex[3] = {p[1], p[1] ? p[2] : 0, 0};
+				*w++ = (char) strtol(hex, NULL, 16);
+				p += strlen(hex);
+				break;
+			}
+			default: *w++ = *p; break;
+		}
+	}
+	return (size_t) (w - s);
+}
+
+/** Dump a serialized message, escaping non-printable bytes */
+static void dump_message(const char *buf, size_t len, bool more, void *arg)
+{
+	DumpCtx *ctx = arg;
+	char esc[5];
+
+	for (size_t i = 0; i < len; i++) {
+		u8 c = (u8) buf[i];
+		size_t n;
+		if (c >= 0x20 && c < 0x7F && c != '\\') {
+			esc[0] = (char) c;
+			n = 1;
+		} else {
+			n = (size_t) sprintf(esc, "\\x%02x", c);
+		}
+
+		if (ctx->col == 0 || ctx->col + n > DUMP_LINE_LEN) {
+			out_write(ctx->out, ctx->col ? "\n  " : "  ", ctx->col ? 3 : 2);
+			ctx->col = 2;
+		}
+		out_write(ctx->out, esc, n);
+		ctx->col += n;
+	}
+
+	ctx->msgs++;
+	if (more) {
+		// message boundary of a fragmented update
+		out_write(ctx->out, "\n  --", 5);
+		ctx->col = DUMP_LINE_LEN;
+	}
+}
+
+/**
+ * Run a script in one format
+ *
+ * @return false on a syntax error
+ */
+static bool run_script(const char *name, const char *script, ScreenNotifyTopics flags, OutBuf *out, RunStats *stats)
+{
+	char *copy = strdup(script);
+	char *rest = copy;
+	char *line;
+	int lineno = 0;
+	bool ok = true;
+
+	host_terminal_reset(80, 25);
+	memset(stats, 0, sizeof(*stats));
+
+	while ((line = strsep(&rest, "\n")) != NULL) {
+		lineno++;
+		size_t ll = strlen(line);
+		if (ll > 0 && line[ll - 1] == '\r') line[ll - 1] = 0;
+		if (line[0] == 0 || line[0] == '#') continue;
+
+		char *arg = strchr(line, ' ');
+		if (arg) *arg++ = 0;
+
+		if (streq(line, "size")) {
+			int w, h;
+			if (!arg || sscanf(arg, "%d %d", &w, &h) != 2) goto syntax;
+			host_terminal_reset(w, h);
+		}
+		else if (streq(line, "feed")) {
+			if (!arg) goto syntax;
+			size_t n = unescape(arg);
+			host_feed(arg, n, n ? n : 1);
+		}
+		else if (streq(line, "repeat")) {
+			char *text;
+			long cnt = arg ? strtol(arg, &text, 10) : 0;
+			if (cnt <= 0 || *text != ' ') goto syntax;
+			text++;
+			size_t n = unescape(text);
+			for (long i = 0; i < cnt; i++) host_feed(text, n, n ? n : 1);
+		}
+		else if (streq(line, "frame") || streq(line, "initial")) {
+			bool initial = streq(line, "initial");
+			OutBuf body = {0};
+			DumpCtx ctx = {.out = &body};
+
+			size_t len = initial ? host_frame_initial(flags, dump_message, &ctx)
+								 : host_frame(flags, dump_message, &ctx);
+
+			stats->frames++;
+			stats->bytes += len;
+			out_printf(out, "%s %d: %zu B", line, stats->frames, len);
+			if (ctx.msgs > 1) out_printf(out, " in %d messages", ctx.msgs);
+			out_write(out, "\n", 1);
+			if (body.len) {
+				out_write(out, body.data, body.len);
+				out_write(out, "\n", 1);
+			}
+			free(body.data);
+		}
+		else {
+			goto syntax;
+		}
+		continue;
+
+syntax:
+		error("%s:%d: bad command \"%s\"", name, lineno, line);
+		ok = false;
+		break;
+	}
+
+	free(copy);
+	return ok;
+}
+
+/** Total size of a format recorded in a golden file, -1 if missing */
+static long recorded_size(const char *golden, const char *fmt)
+{
+	char key[32];
+	snprintf(key, sizeof(key), "# %s: ", fmt);
+	const char *p = strstr(golden, key);
+	if (!p) return -1;
+	p = strstr(p, "frames, ");
+	return p ? strtol(p + 8, NULL, 10) : -1;
+}
+
+/** Print the first differing line */
+static void show_difference(const char *expected, const char *actual)
+{
+	int line = 1;
+	const char *e = expected, *a = actual;
+	while (*e && *e == *a) {
+		if (*e == '\n') line++;
+		e++;
+		a++;
+	}
+	while (e > expected && e[-1] != '\n') e--;
+	while (a > actual && a[-1] != '\n') a--;
+	fprintf(stderr, "  first difference at line %d:\n  - %.*s\n  + %.*s\n", line,
+			(int) strcspn(e, "\n"), e, (int) strcspn(a, "\n"), a);
+}
+
+/**
+ * Run one case and check or write its golden file
+ *
+ * @return true if it passed
+ */
+static bool run_case(const char *path, bool update)
+{
+	size_t slen;
+	char *script = read_file(path, &slen);
+	if (!script) {
+		perror(path);
+		return false;
+	}
+
+	// case.txt -> case.golden
+	char golden_path[512];
+	const char *dot = strrchr(path, '.');
+	size_t base = dot ? (size_t) (dot - path) : strlen(path);
+	snprintf(golden_path, sizeof(golden_path), "%.*s.golden", (int) base, path);
+
+	OutBuf text = {0}, bin = {0}, out = {0};
+	RunStats st_text, st_bin;
+	bool ok = run_script(path, script, 0, &text, &st_text)
+			  && run_script(path, script, TOPIC_FLAG_BINARY, &bin, &st_bin);
+	free(script);
+
+	if (ok) {
+		out_printf(&out, "# %s - generated by host/golden-tool, do not edit\n", path);
+		out_printf(&out, "# text: %d frames, %zu B\n", st_text.frames, st_text.bytes);
+		out_printf(&out, "# binary: %d frames, %zu B\n", st_bin.frames, st_bin.bytes);
+		out_write(&out, "\n== text ==\n", 12);
+		out_write(&out, text.data ? text.data : "", text.len);
+		out_write(&out, "\n== binary ==\n", 14);
+		out_write(&out, bin.data ? bin.data : "", bin.len);
+
+		if (update) {
+			FILE *f = fopen(golden_path, "wb");
+			if (!f || fwrite(out.data, 1, out.len, f) != out.len) {
+				perror(golden_path);
+				ok = false;
+			}
+			if (f) fclose(f);
+			if (ok) printf("WROTE %s  text %zu B, binary %zu B\n", golden_path, st_text.bytes, st_bin.bytes);
+		}
+		else {
+			size_t glen;
+			char *golden = read_file(golden_path, &glen);
+			if (!golden) {
+				fprintf(stderr, "FAIL  %s: no golden file, run with -u to create it\n", path);
+				ok = false;
+			}
+			else if (glen != out.len || memcmp(golden, out.data, glen) != 0) {
+				long was_text = recorded_size(golden, "text");
+				long was_bin = recorded_size(golden, "binary");
+				fprintf(stderr, "FAIL  %s: text %ld -> %zu B (%+ld), binary %ld -> %zu B (%+ld)\n", path,
+						was_text, st_text.bytes, (long) st_text.bytes - was_text,
+						was_bin, st_bin.bytes, (long) st_bin.bytes - was_bin);
+				show_difference(golden, out.data);
+				ok = false;
+			}
+			else {
+				printf("ok    %s  text %zu B, binary %zu B\n", path, st_text.bytes, st_bin.bytes);
+			}
+			free(golden);
+		}
+	}
+
+	free(text.data);
+	free(bin.data);
+	free(out.data);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	bool update = false;
+	int c;
+	while ((c = getopt(argc, argv, "uh")) != -1) {
+		switch (c) {
+			case 'u':
+				update = true;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-u] case.txt...\n", argv[0]);
+				return c != 'h';
+		}
+	}
+
+	int failed = 0, total = 0;
+	for (int i = optind; i < argc; i++) {
+		total++;
+		if (!run_case(argv[i], update)) failed++;
+	}
+
+	if (!update) printf("%d of %d cases passed\n", total - failed, total);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+/**
+ * Host build of the terminal core - driving the parser and the serializer
+ */
+
+#include <esp8266.h>
+#include "host.h"
+#include "persist.h"
+#include "screen.h"
+#include "ansi_parser.h"
+
+/** Changes not yet sent to the emulated client */
+static ScreenDirty client_dirty;
+
+void host_terminal_reset(int width, int height)
+{
+	terminal_restore_defaults();
+	termconf->width = (u32) width;
+	termconf->height = (u32) height;
+	terminal_apply_settings();
+	ansi_parser_reset();
+
+	memset(&client_dirty, 0, sizeof(client_dirty));
+	screen_dirty_reset();
+	host_pending_topics = 0;
+}
+
+void host_feed(const char *buf, size_t len, size_t chunk)
+{
+	for (size_t i = 0; i < len; i += chunk) {
+		ansi_parser_feed(buf + i, (len - i < chunk) ? len - i : chunk);
+	}
+	ansi_parser_flush();
+}
+
+/** Serialize one update, handing each message to the callback */
+static size_t host_serialize(ScreenNotifyTopics topics, const ScreenDirty *dirty, HostFrameCb cb, void *arg)
+{
+	static char buf[HOST_SOCK_BUF_LEN];
+
+	size_t total = 0;
+	void *data = NULL;
+	httpd_cgi_state cont;
+	do {
+		size_t len;
+		cont = screenSerializeToBuffer(buf, HOST_SOCK_BUF_LEN, &len, topics, dirty, &data);
+		if (cb) cb(buf, len, cont == HTTPD_CGI_MORE, arg);
+		total += len;
+	} while (cont != HTTPD_CGI_DONE);
+
+	// cleanup
+	screenSerializeToBuffer(NULL, 0, NULL, 0, NULL, &data);
+	return total;
+}
+
+size_t host_frame(ScreenNotifyTopics flags, HostFrameCb cb, void *arg)
+{
+	// the debug topic is opt-in
+	ScreenNotifyTopics topics = (ScreenNotifyTopics) (host_pending_topics & ~TOPIC_INTERNAL);
+	host_pending_topics = 0;
+	if (topics == 0) return 0;
+
+	// the client gets every frame, so it always has the content up to the last one
+	screen_dirty_merge(&client_dirty);
+	size_t total = host_serialize(topics | flags | TOPIC_FLAG_SHADOW, &client_dirty, cb, arg);
+
+	memset(&client_dirty, 0, sizeof(client_dirty));
+	screen_dirty_reset();
+	return total;
+}
+
+size_t host_frame_initial(ScreenNotifyTopics flags, HostFrameCb cb, void *arg)
+{
+	return host_serialize(TOPIC_INITIAL | TOPIC_FLAG_NOCLEAN | flags, NULL, cb, arg);
+}
@@ -0,0 +1,60 @@
+/**
+ * Host build of the terminal core (parser, screen, serializer),
+ * for benchmarks and tests off-device.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <esp8266.h>
+#include "screen.h"
+
+/** Update message buffer size, as in cgi_sockets.c */
+#define HOST_SOCK_BUF_LEN 2000
+
+/** Topics notified by the screen since the last frame, see screen_notifyChange() in stubs.c */
+extern ScreenNotifyTopics host_pending_topics;
+
+/** Called with each message of a frame, more is true if another one follows */
+typedef void (*HostFrameCb)(const char *buf, size_t len, bool more, void *arg);
+
+/**
+ * Reset the terminal to defaults with the given screen size
+ *
+ * @param width - columns
+ * @param height - rows
+ */
+void host_terminal_reset(int width, int height);
+
+/**
+ * Feed received bytes to the parser, like the UART task does
+ *
+ * @param buf - data
+ * @param len - data length
+ * @param chunk - bytes handed to the parser at once
+ */
+void host_feed(const char *buf, size_t len, size_t chunk);
+
+/**
+ * Serialize the changes since the last frame as one update, the way
+ * cgi_sockets.c does for a single client subscribed to the default topics.
+ *
+ * @param flags - topic flags to add (TOPIC_FLAG_BINARY)
+ * @param cb - called with each message, can be NULL
+ * @param arg - passed to cb
+ * @return bytes serialized, 0 if there was nothing to send
+ */
+size_t host_frame(ScreenNotifyTopics flags, HostFrameCb cb, void *arg);
+
+/**
+ * Serialize the whole screen, as sent to a newly connected client.
+ * Pending changes are left for the next host_frame().
+ *
+ * @param flags - topic flags to add (TOPIC_FLAG_BINARY)
+ * @param cb - called with each message, can be NULL
+ * @param arg - passed to cb
+ * @return bytes serialized
+ */
+size_t host_frame_initial(ScreenNotifyTopics flags, HostFrameCb cb, void *arg);
+
+#endif // HOST_H
@@ -0,0 +1,365 @@
+/**
+ * Tests of the UART ring buffers (user/uart_buffer.c).
+ *
+ * The UART registers are emulated: the Rx FIFO produces a known byte
+ * sequence and the Tx FIFO checks the sequence it receives. The first
+ * tests walk the Rx ring through the cases that need care - spans ending
+ * at the end of the array and the wrap-around of the 16-bit indices.
+ * The stress test then runs the producer and the consumer of both rings
+ * in separate threads, like the interrupt and the tasks on the chip.
+ *
+ * Usage: ring-test [megabytes]
+ */
+
+#include <esp8266.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include "uart_driver.h"
+#include "uart_buffer.h"
+#include "uart_handler.h"
+
+/** Bytes passed through each ring in the stress test, unless given */
+#define STRESS_DEFAULT_MB 64
+
+/** Period of the test byte sequence, coprime with the ring size to catch misplaced data */
+#define SEQ_PERIOD 251
+
+#define RX_SIZE UART_RX_BUFFER_SIZE
+
+static int failures = 0;
+
+#define check(cond, fmt, ...) do { \
+		if (!(cond)) { \
+			fprintf(stderr, "FAIL  %s:%d: " fmt "\n", __func__, __LINE__, ##__VA_ARGS__); \
+			failures++; \
+			return; \
+		} \
+	} while (0)
+
+// --- emulated UART ---
+
+/** Bytes waiting in the Rx FIFO, per thread (only the Rx producer has any) */
+static __thread u32 rx_fifo_count;
+/** Sequence number of the next byte the Rx FIFO produces */
+static u32 rx_fifo_seq;
+/** Sequence number of the next byte the Tx FIFO expects */
+static u32 tx_fifo_seq;
+static volatile bool tx_fifo_error;
+
+static inline u8 seq_byte(u32 n)
+{
+	return (u8) (n % SEQ_PERIOD);
+}
+
+u32 host_reg_read(u32 addr)
+{
+	if (addr == UART_STATUS(UART0)) {
+		// the Tx FIFO always drains at once
+		return (rx_fifo_count & UART_RXFIFO_CNT) << UART_RXFIFO_CNT_S;
+	}
+	if (addr == UART_FIFO(UART0)) {
+		if (rx_fifo_count == 0) return 0;
+		rx_fifo_count--;
+		return seq_byte(rx_fifo_seq++);
+	}
+	return 0;
+}
+
+void host_reg_write(u32 addr, u32 val)
+{
+	if (addr == UART_FIFO(UART0)) {
+		if ((u8) val != seq_byte(tx_fifo_seq)) tx_fifo_error = true;
+		tx_fifo_seq++;
+	}
+}
+
+STATUS UART_WriteChar(UARTn uart_no, uint8 c, uint32 timeout_us)
+{
+	(void) uart_no;
+	(void) c;
+	(void) timeout_us;
+	return OK;
+}
+
+void notify_empty_txbuf(void) {}
+
+/** Let the emulated FIFO deliver n bytes (at most the FIFO size at once) into the Rx ring */
+static void rx_deliver(u32 n)
+{
+	while (n > 0) {
+		u32 chunk = n < UART_FIFO_LEN ? n : UART_FIFO_LEN;
+		rx_fifo_count = chunk;
+		UART_RxFifoCollect();
+		n -= chunk;
+	}
+}
+
+/** Reset the rings and the emulated FIFOs, returns the start of the Rx array */
+static const char *reset_all(void)
+{
+	const char *base;
+	UART_AllocBuffers();
+	memset(&uart_stats, 0, sizeof(uart_stats));
+	rx_fifo_seq = tx_fifo_seq = 0;
+	tx_fifo_error = false;
+	UART_RxPeek(&base);
+	return base;
+}
+
+// --- single threaded tests ---
+
+/** Peek and commit at the end of the array */
+static void test_peek_at_end(void)
+{
+	const char *base = reset_all();
+	const char *p;
+	char buf[RX_SIZE];
+
+	// move the indices 10 bytes before the end of the array
+	rx_deliver(RX_SIZE - 10);
+	check(UART_ReadAsync(buf, RX_SIZE) == RX_SIZE - 10, "fill");
+	check(UART_AsyncRxCount() == 0, "empty");
+
+	rx_deliver(30);
+	check(UART_AsyncRxCount() == 30, "count %d", UART_AsyncRxCount());
+
+	// the first span ends with the array
+	u16 n = UART_RxPeek(&p);
+	check(n == 10 && p == base + RX_SIZE - 10, "span 1: %d at %td", n, p - base);
+	check((u8) p[0] == seq_byte(RX_SIZE - 10) && (u8) p[9] == seq_byte(RX_SIZE - 1), "span 1 data");
+
+	// commit it in two parts
+	UART_RxCommit(4);
+	n = UART_RxPeek(&p);
+	check(n == 6 && p == base + RX_SIZE - 6, "partial commit: %d at %td", n, p - base);
+	UART_RxCommit(6);
+
+	// the rest continues at the start
+	n = UART_RxPeek(&p);
+	check(n == 20 && p == base, "span 2: %d at %td", n, p - base);
+	check((u8) p[0] == seq_byte(RX_SIZE) && (u8) p[19] == seq_byte(RX_SIZE + 19), "span 2 data");
+	UART_RxCommit(20);
+
+	check(UART_RxPeek(&p) == 0, "empty at the end");
+}
+
+/** UART_ReadAsync across the end of the array */
+static void test_read_async(void)
+{
+	reset_all();
+	char buf[RX_SIZE];
+
+	rx_deliver(RX_SIZE - 5);
+	check(UART_ReadAsync(buf, RX_SIZE) == RX_SIZE - 5, "fill");
+
+	// a read that needs both pieces
+	rx_deliver(40);
+	u16 n = UART_ReadAsync(buf, 20);
+	check(n == 20, "read 20: %d", n);
+	for (u32 i = 0; i < n; i++) {
+		check((u8) buf[i] == seq_byte(RX_SIZE - 5 + i), "byte %u", i);
+	}
+
+	// the remainder, asking for more than there is
+	n = UART_ReadAsync(buf, sizeof(buf));
+	check(n == 20, "read rest: %d", n);
+	for (u32 i = 0; i < n; i++) {
+		check((u8) buf[i] == seq_byte(RX_SIZE + 15 + i), "byte %u", i);
+	}
+	check(UART_ReadAsync(buf, sizeof(buf)) == 0, "empty");
+
+	// exactly full
+	rx_deliver(RX_SIZE - 1);
+	check(UART_AsyncRxCount() == RX_SIZE - 1, "near full %d", UART_AsyncRxCount());
+	n = UART_ReadAsync(buf, sizeof(buf));
+	check(n == RX_SIZE - 1, "read full: %d", n);
+	check((u8) buf[0] == seq_byte(RX_SIZE + 35) && (u8) buf[n - 1] == seq_byte(2 * RX_SIZE + 33), "full data");
+}
+
+/** Free-running indices wrapping around 0xFFFF with data in the ring */
+static void test_index_wrap(void)
+{
+	reset_all();
+	char buf[RX_SIZE];
+	u32 held = 0, read = 0, splits = 0;
+
+	// keep a few hundred bytes in the ring while the indices go around several times
+	for (u32 step = 0; read < 3 * 65536 + 1000; step++) {
+		u32 in = 37 + (step * 53) % 120;
+		if (held + in < RX_SIZE) {
+			rx_deliver(in);
+			held += in;
+		}
+		check(UART_AsyncRxCount() == held, "count %d, expected %u", UART_AsyncRxCount(), held);
+
+		if (held > 300) {
+			const char *p;
+			u16 n = UART_RxPeek(&p);
+			if (n < held) splits++;
+
+			u16 want = (u16) (held - 300);
+			if (step & 1) {
+				// zero-copy path, possibly only the first span
+				if (want > n) want = n;
+				for (u32 i = 0; i < want; i++) buf[i] = p[i];
+				UART_RxCommit(want);
+			} else {
+				want = UART_ReadAsync(buf, want);
+			}
+
+			for (u32 i = 0; i < want; i++) {
+				check((u8) buf[i] == seq_byte(read + i), "byte %u", read + i);
+			}
+			read += want;
+			held -= want;
+		}
+	}
+	check(splits > 0, "no span ended at the end of the array");
+}
+
+/** Tx ring, filled and dispatched in turns */
+static void test_tx(void)
+{
+	reset_all();
+	char buf[300];
+	u32 sent = 0;
+
+	for (u32 step = 0; sent < 3 * 65536; step++) {
+		u32 n = 1 + (step * 97) % 299;
+		if (n <= UART_AsyncTxGetEmptySpace()) {
+			for (u32 i = 0; i < n; i++) buf[i] = (char) seq_byte(sent + i);
+			UART_SendAsync(buf, (int) n);
+			sent += n;
+		}
+		check(UART_AsyncTxCount() + tx_fifo_seq == sent, "tx count");
+		if (step % 3 == 0) UART_DispatchFromTxBuffer(UART0);
+	}
+	while (UART_AsyncTxCount() > 0) UART_DispatchFromTxBuffer(UART0);
+
+	check(tx_fifo_seq == sent, "sent %u, dispatched %u", sent, tx_fifo_seq);
+	check(!tx_fifo_error, "wrong data in the Tx FIFO");
+	check(uart_stats.tx_dropped == 0, "dropped %u", uart_stats.tx_dropped);
+}
+
+// --- threaded stress test ---
+
+static u32 stress_len;
+static volatile u32 rx_produced;
+
+/** Rx producer - the UART interrupt / recv task */
+static void *rx_producer(void *arg)
+{
+	(void) arg;
+	u32 rnd = 1;
+	while (rx_produced < stress_len) {
+		rnd = rnd * 1103515245u + 12345u;
+		u32 n = (rnd >> 16) % UART_FIFO_LEN + 1;
+		if (n > stress_len - rx_produced) n = stress_len - rx_produced;
+		// only take what fits, as the interrupt is off while the ring is full
+		if (n >= (u32) (RX_SIZE - UART_AsyncRxCount())) {
+			sched_yield();
+			continue;
+		}
+
+		rx_fifo_count = n;
+		UART_RxFifoCollect();
+		rx_produced += n;
+	}
+	return NULL;
+}
+
+/** Tx consumer - the FIFO empty interrupt */
+static void *tx_consumer(void *arg)
+{
+	(void) arg;
+	while (tx_fifo_seq < stress_len) {
+		if (UART_AsyncTxCount() == 0) sched_yield();
+		UART_DispatchFromTxBuffer(UART0);
+	}
+	return NULL;
+}
+
+static void stress_timeout(int sig)
+{
+	(void) sig;
+	fprintf(stderr, "FAIL  stress test stuck: rx %u/%u, tx %u/%u\n",
+			rx_produced, stress_len, tx_fifo_seq, stress_len);
+	_exit(1);
+}
+
+/** Both rings with their producer and consumer in separate threads */
+static void test_stress(void)
+{
+	reset_all();
+	signal(SIGALRM, stress_timeout);
+	alarm(60);
+
+	pthread_t rx_thread, tx_thread;
+	pthread_create(&rx_thread, NULL, rx_producer, NULL);
+	pthread_create(&tx_thread, NULL, tx_consumer, NULL);
+
+	// this thread is the Rx consumer and Tx producer - the tasks
+	u32 received = 0, sent = 0, rnd = 7;
+	bool rx_error = false;
+	char buf[300];
+	while (received < stress_len || sent < stress_len) {
+		rnd = rnd * 1103515245u + 12345u;
+		u32 r = rnd >> 16;
+
+		if (r & 1) {
+			const char *p;
+			u16 n = UART_RxPeek(&p);
+			if (n > r % 200) n = (u16) (r % 200);
+			for (u32 i = 0; i < n; i++) {
+				if ((u8) p[i] != seq_byte(received + i)) rx_error = true;
+			}
+			UART_RxCommit(n);
+			received += n;
+		} else {
+			u16 n = UART_ReadAsync(buf, (u16) (r % 300));
+			for (u32 i = 0; i < n; i++) {
+				if ((u8) buf[i] != seq_byte(received + i)) rx_error = true;
+			}
+			received += n;
+		}
+
+		if (UART_AsyncRxCount() == 0 && UART_AsyncTxGetEmptySpace() < 256) sched_yield();
+
+		u32 m = 1 + (r >> 4) % 256;
+		if (m > stress_len - sent) m = stress_len - sent;
+		if (m > 0 && m <= UART_AsyncTxGetEmptySpace()) {
+			for (u32 i = 0; i < m; i++) buf[i] = (char) seq_byte(sent + i);
+			UART_SendAsync(buf, (int) m);
+			sent += m;
+		}
+	}
+
+	pthread_join(rx_thread, NULL);
+	pthread_join(tx_thread, NULL);
+	alarm(0);
+
+	check(!rx_error, "wrong data from the Rx ring");
+	check(!tx_fifo_error, "wrong data in the Tx FIFO");
+	check(received == stress_len && tx_fifo_seq == stress_len, "rx %u, tx %u", received, tx_fifo_seq);
+	check(uart_stats.rx_dropped == 0 && uart_stats.tx_dropped == 0, "dropped data");
+}
+
+int main(int argc, char **argv)
+{
+	stress_len = (u32) (argc > 1 ? atoi(argv[1]) : STRESS_DEFAULT_MB) * 1024 * 1024;
+
+	test_peek_at_end();
+	test_read_async();
+	test_index_wrap();
+	test_tx();
+	test_stress();
+
+	if (failures) {
+		printf("ring buffers: %d tests failed\n", failures);
+		return 1;
+	}
+	printf("ring buffers: ok (stress %u MB each way)\n", stress_len / (1024 * 1024));
+	return 0;
+}
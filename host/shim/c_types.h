@@ -0,0 +1,40 @@
+/**
+ * Host build shim for the SDK's c_types.h.
+ *
+ * The SDK copy defines size_t as a 32-bit int, which clashes with a 64-bit host.
+ * This one uses the same include guard, so the SDK headers that include it
+ * directly (eagle_soc.h) get these definitions instead.
+ */
+
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef int8_t s8;
+typedef uint16_t u16;
+typedef int16_t s16;
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint8_t uint8;
+typedef int8_t sint8;
+typedef uint16_t uint16;
+typedef int16_t sint16;
+typedef uint32_t uint32;
+typedef int32_t sint32;
+
+typedef enum {
+	OK = 0,
+	FAIL,
+	PENDING,
+	BUSY,
+	CANCEL,
+} STATUS;
+
+#define BIT(nr) (1UL << (nr))
+#define LOCAL static
+
+#endif // _C_TYPES_H_
@@ -0,0 +1,17 @@
+/**
+ * Host build shim for libesphttpd's cgiwebsocket.h
+ */
+
+#ifndef HOST_SHIM_CGIWEBSOCKET_H
+#define HOST_SHIM_CGIWEBSOCKET_H
+
+#include "httpd.h"
+
+#define WEBSOCK_FLAG_NONE 0
+#define WEBSOCK_FLAG_MORE (1<<0)
+#define WEBSOCK_FLAG_BIN (1<<1)
+#define WEBSOCK_FLAG_CONT (1<<2)
+
+typedef struct Websock Websock;
+
+#endif // HOST_SHIM_CGIWEBSOCKET_H
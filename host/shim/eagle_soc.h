@@ -0,0 +1,23 @@
+/**
+ * Host build shim for the SDK register header.
+ *
+ * The SDK header is used as it is, only the peripheral register accessors
+ * are routed to functions, so a test can emulate the hardware behind them.
+ */
+
+#ifndef HOST_SHIM_EAGLE_SOC_H
+#define HOST_SHIM_EAGLE_SOC_H
+
+#include_next "eagle_soc.h"
+
+/** Read a peripheral register, provided by the program that uses the registers */
+u32 host_reg_read(u32 addr);
+/** Write a peripheral register, provided by the program that uses the registers */
+void host_reg_write(u32 addr, u32 val);
+
+#undef READ_PERI_REG
+#undef WRITE_PERI_REG
+#define READ_PERI_REG(addr) host_reg_read((u32) (addr))
+#define WRITE_PERI_REG(addr, val) host_reg_write((u32) (addr), (u32) (val))
+
+#endif // HOST_SHIM_EAGLE_SOC_H
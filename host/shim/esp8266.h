@@ -0,0 +1,64 @@
+/**
+ * Host build shim for the ESP8266 SDK / libesphttpd umbrella header.
+ *
+ * Only what the code built on the host uses is provided.
+ * The SDK register headers are used as they are, see c_types.h.
+ */
+
+#ifndef HOST_SHIM_ESP8266_H
+#define HOST_SHIM_ESP8266_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c_types.h"
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+#define ESP_CONST_DATA
+#define LOCAL static
+
+// Logging is silenced unless built with HOST_LOG=1, it would dominate the timing
+#if HOST_LOG
+#define dbg(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define info(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define warn(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#else
+#define dbg(fmt, ...) ((void)0)
+#define info(fmt, ...) ((void)0)
+#define warn(fmt, ...) ((void)0)
+#endif
+#define error(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define os_printf printf
+
+#define streq(a, b) (strcmp((const char*)(a), (const char*)(b)) == 0)
+#define strneq(a, b, n) (strncmp((const char*)(a), (const char*)(b), (n)) == 0)
+#define strstarts(a, b) strneq((a), (b), strlen(b))
+
+struct ip_addr { u32 addr; };
+struct dhcps_lease { bool enable; struct ip_addr start_ip; struct ip_addr end_ip; };
+
+typedef void ETSTimerFunc(void *arg);
+typedef struct { ETSTimerFunc *fn; void *arg; } ETSTimer;
+typedef struct { u32 sig; u32 par; } os_event_t;
+typedef void (*os_task_t)(os_event_t *e);
+
+void os_timer_disarm(ETSTimer *t);
+void os_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *arg);
+void os_timer_arm(ETSTimer *t, u32 ms, bool repeat);
+#define TIMER_START(tmr, cb, ms, rep) do { os_timer_disarm(tmr); os_timer_setfn(tmr, cb, NULL); os_timer_arm(tmr, ms, rep); } while(0)
+
+u32 system_get_time(void);
+u32 system_get_free_heap_size(void);
+void system_soft_wdt_feed(void);
+
+#define SOFTAP_IF 1
+#define STATION_IF 0
+void wifi_get_macaddr(int i, u8 *m);
+
+#include <eagle_soc.h>
+
+#endif // HOST_SHIM_ESP8266_H
@@ -0,0 +1,2 @@
+// Host build shim - the HTTP client is not used off-device
+#include "esp8266.h"
@@ -0,0 +1,19 @@
+/**
+ * Host build shim for libesphttpd's httpd.h - just the types used by the serializer
+ */
+
+#ifndef HOST_SHIM_HTTPD_H
+#define HOST_SHIM_HTTPD_H
+
+#include "esp8266.h"
+
+typedef enum {
+	HTTPD_CGI_MORE = 0,
+	HTTPD_CGI_DONE = 1,
+	HTTPD_CGI_NOTFOUND = 2,
+	HTTPD_CGI_AUTHENTICATED = 3,
+} httpd_cgi_state;
+
+typedef struct HttpdConnData HttpdConnData;
+
+#endif // HOST_SHIM_HTTPD_H
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+"""
+Generate synthetic UART streams for the host benchmark.
+
+These are deterministic stand-ins shaped like the output of common
+programs. Real captures can be used the same way, e.g. recorded with
+
+    script -q -c 'htop' htop.raw      (then strip the script(1) header)
+
+or by logging the UART traffic. Any file of raw terminal output works.
+
+Usage: gen.py <output dir>
+"""
+
+import os
+import random
+import sys
+
+ESC = '\x1b'
+CSI = ESC + '['
+
+W, H = 80, 25
+
+WORDS = ('static int void char return if else for while struct const '
+         'buffer length screen cursor parser offset value result state '
+         'size_t uint8_t count index error flags width height').split()
+
+
+def cup(y, x):
+    return '%s%d;%dH' % (CSI, y + 1, x + 1)
+
+
+def sgr(*p):
+    return '%s%sm' % (CSI, ';'.join(str(x) for x in p))
+
+
+def vim(rnd):
+    out = [CSI + '?1049h', CSI + '?25l', CSI + 'H' + CSI + '2J']
+
+    def status(line):
+        return (cup(H - 2, 0) + sgr(1, 7) + ('"main.c" line %d' % line).ljust(W)
+                + sgr(0) + cup(H - 1, 0) + CSI + 'K')
+
+    def code_line():
+        s = ' ' * (4 * rnd.randint(0, 3))
+        for _ in range(rnd.randint(1, 7)):
+            w = rnd.choice(WORDS)
+            if w in ('static', 'int', 'void', 'char', 'return', 'if', 'else',
+                     'for', 'while', 'struct', 'const'):
+                s += sgr(33) + w + sgr(0) + ' '
+            elif rnd.random() < 0.2:
+                s += sgr(35) + '"%s"' % w + sgr(0) + ' '
+            else:
+                s += w + ' '
+        if rnd.random() < 0.15:
+            s += sgr(34) + '// ' + ' '.join(rnd.choice(WORDS) for _ in range(4)) + sgr(0)
+        return s
+
+    # initial draw
+    for y in range(H - 2):
+        out.append(cup(y, 0) + sgr(33) + '%3d ' % (y + 1) + sgr(0) + code_line() + CSI + 'K')
+    out.append(status(1))
+
+    line = 1
+    for _ in range(4000):
+        r = rnd.random()
+        if r < 0.45:
+            # scroll down a line (Ctrl-E / j at the bottom)
+            line += 1
+            out.append(CSI + '?25l' + CSI + '1;%dr' % (H - 2) + cup(H - 3, 0) + '\n'
+                       + CSI + 'r' + cup(H - 3, 0) + sgr(33) + '%3d ' % (line + H - 3)
+                       + sgr(0) + code_line() + CSI + 'K')
+        elif r < 0.8:
+            # typing in insert mode
+            y = rnd.randrange(H - 2)
+            x = rnd.randrange(4, 40)
+            out.append(cup(y, x) + CSI + '?25h')
+            for ch in ' '.join(rnd.choice(WORDS) for _ in range(rnd.randint(1, 3))):
+                out.append(CSI + '@' + ch)
+        elif r < 0.95:
+            # redraw a changed line
+            y = rnd.randrange(H - 2)
+            out.append(cup(y, 4) + code_line() + CSI + 'K')
+        else:
+            # page down, full redraw
+            line += H - 2
+            out.append(CSI + 'H' + CSI + 'J')
+            for y in range(H - 2):
+                out.append(cup(y, 0) + sgr(33) + '%3d ' % (line + y) + sgr(0) + code_line())
+        out.append(status(line))
+    out.append(CSI + '?1049l' + CSI + '?25h')
+    return ''.join(out)
+
+
+def htop(rnd):
+    out = [CSI + '?1049h', CSI + '?25l', CSI + 'H' + CSI + '2J']
+    procs = [(rnd.randrange(1, 32768), rnd.choice(('root', 'www', 'user')),
+              '/usr/bin/' + rnd.choice(WORDS)) for _ in range(60)]
+    for _ in range(700):
+        # meters
+        for cpu in range(4):
+            pct = rnd.random()
+            bars = int(pct * 30)
+            out.append(cup(cpu, 1) + '%d' % (cpu + 1) + sgr(1, 36) + '[' + sgr(0)
+                       + sgr(32) + '|' * (bars // 2) + sgr(31) + '|' * (bars - bars // 2)
+                       + sgr(0) + ' ' * (30 - bars) + sgr(90) + '%5.1f%%' % (pct * 100)
+                       + sgr(1, 36) + ']' + sgr(0))
+        out.append(cup(5, 1) + 'Mem' + sgr(1, 36) + '[' + sgr(32) + '|' * rnd.randint(5, 25)
+                   + sgr(0) + CSI + 'K')
+        out.append(cup(1, 45) + sgr(1) + 'Tasks: ' + sgr(0) + '%d, %d thr; %d running'
+                   % (rnd.randint(80, 120), rnd.randint(200, 400), rnd.randint(1, 5)))
+        out.append(cup(2, 45) + sgr(1) + 'Load average: ' + sgr(0) + '%.2f %.2f %.2f'
+                   % (rnd.random() * 4, rnd.random() * 4, rnd.random() * 4))
+        # header
+        out.append(cup(7, 0) + sgr(30, 42) + '  PID USER      PRI  NI  VIRT   RES  CPU% MEM%   TIME+  Command'.ljust(W) + sgr(0))
+        # process list, sorted differently every time
+        rnd.shuffle(procs)
+        for i, (pid, user, cmd) in enumerate(procs[:H - 9]):
+            row = cup(8 + i, 0)
+            if i == 0:
+                row += sgr(30, 46)
+            row += '%5d %-9s %3d %3d %5dM %5dM %5.1f %4.1f %2d:%05.2f %s' % (
+                pid, user, 20, 0, rnd.randint(10, 900), rnd.randint(1, 200),
+                rnd.random() * 100, rnd.random() * 10, rnd.randint(0, 59),
+                rnd.random() * 60, sgr(1) + cmd + sgr(0))
+            out.append(row + CSI + 'K')
+        out.append(cup(H - 1, 0) + sgr(30, 46) + 'F1' + sgr(0) + 'Help  ' + sgr(30, 46) + 'F10'
+                   + sgr(0) + 'Quit')
+    out.append(CSI + '?1049l' + CSI + '?25h')
+    return ''.join(out)
+
+
+def ls_lr(rnd):
+    out = []
+    colors = {'dir': sgr(1, 34), 'exe': sgr(1, 32), 'lnk': sgr(1, 36), 'arc': sgr(1, 31)}
+    for d in range(600):
+        path = './' + '/'.join(rnd.choice(WORDS) for _ in range(rnd.randint(1, 4)))
+        out.append(path + ':\r\ntotal %d\r\n' % rnd.randint(0, 2000))
+        for _ in range(rnd.randint(2, 25)):
+            kind = rnd.choice(('file', 'file', 'file', 'dir', 'exe', 'lnk', 'arc'))
+            name = rnd.choice(WORDS) + rnd.choice(('', '.c', '.h', '.o', '.tar.gz', '_%d' % rnd.randint(0, 99)))
+            mode = {'dir': 'drwxr-xr-x', 'lnk': 'lrwxrwxrwx', 'exe': '-rwxr-xr-x'}.get(kind, '-rw-r--r--')
+            line = '%s %2d %s %s %8d %s %2d %02d:%02d ' % (
+                mode, rnd.randint(1, 9), 'user', 'users', rnd.randint(0, 10 ** 7),
+                rnd.choice(('Jan', 'Feb', 'Mar', 'Apr', 'May', 'Jun')), rnd.randint(1, 28),
+                rnd.randint(0, 23), rnd.randint(0, 59))
+            if kind in colors:
+                line += colors[kind] + name + CSI + '0m'
+            else:
+                line += name
+            if kind == 'lnk':
+                line += ' -> ' + rnd.choice(WORDS)
+            out.append(line + '\r\n')
+        out.append('\r\n')
+    return ''.join(out)
+
+
+def logstorm(rnd):
+    out = []
+    levels = [('DEBUG', sgr(90)), ('INFO', sgr(32)), ('WARN', sgr(1, 33)),
+              ('ERROR', sgr(1, 31)), ('TRACE', '\x1b[38;5;%dm')]
+    for n in range(25000):
+        lvl, color = rnd.choice(levels)
+        if '%d' in color:
+            color = color % rnd.randrange(16, 256)
+        ts = '%02d:%02d:%02d.%03d' % (n // 3600000 % 24, n // 60000 % 60, n // 1000 % 60, n % 1000)
+        msg = ' '.join(rnd.choice(WORDS) for _ in range(rnd.randint(3, 12)))
+        if rnd.random() < 0.1:
+            # truecolor and unicode sprinkled in
+            msg = '\x1b[38;2;%d;%d;%dm' % (rnd.randrange(256), rnd.randrange(256),
+                                           rnd.randrange(256)) + msg + ' → ✔' + sgr(0)
+        out.append(sgr(2) + ts + sgr(0) + ' ' + color + '%-5s' % lvl + sgr(0) + ' '
+                   + sgr(36) + '[%s]' % rnd.choice(WORDS) + sgr(0) + ' ' + msg + '\r\n')
+    return ''.join(out)
+
+
+STREAMS = {
+    'vim': vim,
+    'htop': htop,
+    'ls-lR': ls_lr,
+    'logstorm': logstorm,
+}
+
+
+def main():
+    outdir = sys.argv[1] if len(sys.argv) > 1 else '.'
+    for name, fn in STREAMS.items():
+        data = fn(random.Random(name)).encode('utf-8')
+        with open(os.path.join(outdir, name + '.bin'), 'wb') as f:
+            f.write(data)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,52 @@
+/**
+ * Stand-ins for the firmware and SDK functions the terminal core calls,
+ * for the host build.
+ */
+
+#include <esp8266.h>
+#include <time.h>
+#include "persist.h"
+#include "syscfg.h"
+#include "screen.h"
+#include "host.h"
+
+PersistBlock persist;
+SystemConfigBundle * const sysconf = &persist.current.sysconf;
+volatile int term_active_clients = 1;
+
+ScreenNotifyTopics host_pending_topics = 0;
+
+u32 system_get_free_heap_size(void)
+{
+	return 40000;
+}
+
+u32 system_get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u32) (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+void system_soft_wdt_feed(void) {}
+void os_timer_disarm(ETSTimer *t) { (void)t; }
+void os_timer_setfn(ETSTimer *t, ETSTimerFunc *fn, void *arg) { (void)t; (void)fn; (void)arg; }
+void os_timer_arm(ETSTimer *t, u32 ms, bool repeat) { (void)t; (void)ms; (void)repeat; }
+void wifi_get_macaddr(int i, u8 *m) { (void)i; memset(m, 0, 6); }
+int getStaIpAsString(char *buf) { (void)buf; return 0; }
+
+// replies to queries from the parser are dropped
+void UART_SendAsync(const char *pdata, int data_len) { (void)pdata; (void)data_len; }
+
+void persist_store(void) {}
+bool d2d_parse_command(char *msg) { (void)msg; return false; }
+
+// websocket side, see cgi_sockets.c
+void send_beep(void) { screen_notifyChange(TOPIC_BELL); }
+void notify_growl(char *msg) { (void)msg; }
+void screen_notifyHold(bool hold) { (void)hold; }
+
+void screen_notifyChange(ScreenNotifyTopics topics)
+{
+	host_pending_topics |= topics;
+}
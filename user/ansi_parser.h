@@ -10,7 +10,11 @@ extern volatile bool ansi_parser_inhibit; // discard all characters
 
 void ansi_parser_reset(void);
 
+/** Write out printable characters the parser is still holding (call after a chunk of input) */
+void ansi_parser_flush(void);
+
 extern volatile u32 ansi_parser_char_cnt;
+extern volatile u32 ansi_parser_error_cnt; // bad sequences discarded
 
 /**
  * \brief Linear ANSI chars stream parser
@@ -26,6 +30,15 @@ extern volatile u32 ansi_parser_char_cnt;
  */
 void ansi_parser(char newchar);
 
+/**
+ * Parse a buffer of received bytes. Runs of printable characters outside
+ * of escape sequences are written to the screen as a whole.
+ *
+ * \param buf - received bytes
+ * \param len - number of bytes
+ */
+void ansi_parser_feed(const char *buf, size_t len);
+
 /** This shows a short error message and prints the history (if any) */
 void apars_show_context(void);
 
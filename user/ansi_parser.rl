@@ -16,10 +16,12 @@ static volatile bool inside_string = false;
 
 // public
 volatile u32 ansi_parser_char_cnt = 0;
+volatile u32 ansi_parser_error_cnt = 0;
 volatile bool ansi_parser_inhibit = 0;
 
 void ICACHE_FLASH_ATTR
 ansi_parser_reset(void) {
+	apars_flush_plainchars();
 	if (cs != ansi_start) {
 		cs = ansi_start;
 		inside_string = false;
@@ -28,6 +30,11 @@ ansi_parser_reset(void) {
 	}
 }
 
+void ICACHE_FLASH_ATTR
+ansi_parser_flush(void) {
+	apars_flush_plainchars();
+}
+
 #define HISTORY_LEN 10
 
 #if DEBUG_ANSI
@@ -116,6 +123,8 @@ ansi_parser(char newchar)
 
 	// Handle simple characters immediately (bypass parser)
 	if (newchar < ' ' && !inside_string) {
+		apars_flush_plainchars();
+
 		switch (newchar) {
 			case ESC:
 				// Reset state
@@ -167,6 +176,8 @@ ansi_parser(char newchar)
 		}
 	}
 	
+	apars_flush_plainchars();
+
 	// Load new data to Ragel vars
 	const char *p = &newchar;
 	const char *eof = NULL;
@@ -184,6 +195,7 @@ ansi_parser(char newchar)
 
 		action errBadSeq {
 			ansi_warn("Parser error.");
+			ansi_parser_error_cnt++;
 			apars_show_context();
 			inside_string = false; // no longer in string, for sure
 			fgoto main;
@@ -320,3 +332,86 @@ ansi_parser(char newchar)
 #*/
 	}%%
 }
+
+/**
+ * Get the length of the printable ASCII run (0x20..0x7E) at the start of a buffer.
+ *
+ * The buffer is checked a 32-bit word at a time, once aligned - plain text
+ * is the bulk of the traffic.
+ *
+ * \param buf - bytes to check
+ * \param len - number of bytes
+ * \return number of leading printable bytes
+ */
+static size_t ICACHE_FLASH_ATTR
+apars_printable_len(const char *buf, size_t len)
+{
+	size_t i = 0;
+
+	// byte by byte until aligned for word reads
+	while (i < len && ((size_t) (buf + i) & 3)) {
+		if ((u8) buf[i] < ' ' || (u8) buf[i] >= DEL) return i;
+		i++;
+	}
+
+	typedef u32 __attribute__((__may_alias__)) u32_word;
+	for (; i + 4 <= len; i += 4) {
+		const u32 w = *(const u32_word *) (buf + i);
+		// some byte < 0x20, or some byte > 0x7E (including >= 0x80)
+		const u32 low = (w - 0x20202020UL) & ~w & 0x80808080UL;
+		const u32 high = ((w + 0x01010101UL) | w) & 0x80808080UL;
+		if (low | high) break;
+	}
+
+	while (i < len && (u8) buf[i] >= ' ' && (u8) buf[i] < DEL) i++;
+	return i;
+}
+
+/**
+ * Parse a buffer of received bytes.
+ *
+ * Runs of printable ASCII and of UTF-8 sequence bytes (0x80-0xFF) in the ground
+ * state are handled in one call, everything else is passed to ansi_parser()
+ * byte by byte.
+ *
+ * \param buf - received bytes
+ * \param len - number of bytes
+ */
+void ICACHE_FLASH_ATTR
+ansi_parser_feed(const char *buf, size_t len)
+{
+	size_t i = 0;
+	while (i < len) {
+		if (cs == ansi_start && !inside_string && !ansi_parser_inhibit && !termconf_live.ascii_debug) {
+			size_t end = i + apars_printable_len(buf + i, len - i);
+			const bool ascii = (end > i);
+			if (!ascii) {
+				while (end < len && (u8) buf[end] >= 0x80) end++;
+			}
+
+			if (end > i) {
+				size_t n = end - i;
+				ansi_parser_char_cnt += n;
+
+				#if DEBUG_ANSI
+					if (n >= HISTORY_LEN) {
+						memcpy(history, buf + end - HISTORY_LEN, HISTORY_LEN);
+					} else {
+						memmove(history, history + n, HISTORY_LEN - n);
+						memcpy(history + HISTORY_LEN - n, buf + i, n);
+					}
+				#endif
+
+				if (ascii) {
+					apars_handle_plainchars(buf + i, n);
+				} else {
+					apars_handle_utf8(buf + i, n);
+				}
+				i = end;
+				continue;
+			}
+		}
+
+		ansi_parser(buf[i++]);
+	}
+}
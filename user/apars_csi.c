@@ -733,7 +733,7 @@ do_csi_set_private_option(CSI_Data *opts)
 		}
 		else if (n == 47 || n == 1047) {
 			// Switch to/from alternate screen
-			//  - not implemented fully due to RAM demands
+			//  - the main screen content is kept only if there's enough RAM
 			screen_swap_state(yn);
 		}
 		else if (n == 1048) {
@@ -744,12 +744,12 @@ do_csi_set_private_option(CSI_Data *opts)
 			// save/restore cursor and screen and clear it
 			if (yn) {
 				screen_cursor_save(true);
-				screen_swap_state(true); // this should save the screen - can't because of RAM size
+				screen_swap_state(true); // also saves the screen content, if RAM allows
 				screen_clear(CLEAR_ALL);
 			}
 			else {
 				screen_clear(CLEAR_ALL);
-				screen_swap_state(false); // this should restore the screen - can't because of RAM size
+				screen_swap_state(false); // restores the screen content, if it was saved
 				screen_cursor_restore(true);
 			}
 		}
@@ -757,6 +757,10 @@ do_csi_set_private_option(CSI_Data *opts)
 			// Bracketed paste mode
 			screen_set_bracketed_paste(yn);
 		}
+		else if (n == 2026) {
+			// Synchronized update - the screen is sent when it ends
+			screen_set_synchronized_update(yn);
+		}
 		else if (n == 800) { // ESPTerm: Toggle display of buttons
 			termconf_live.show_buttons = yn;
 			screen_notifyChange(TOPIC_CHANGE_SCREEN_OPTS); // this info is included in the screen preamble
@@ -1,7 +1,7 @@
 //
 // Created by MightyPork on 2017/08/20.
 //
-// UTF-8 parser - collects bytes of a code point before writing them
+// UTF-8 parser - validates the bytes of a code point before writing them
 // into a screen cell.
 //
 
@@ -13,22 +13,6 @@
 #include "ansi_parser.h"
 #include "ascii.h"
 
-static u8 bytes[4];
-static int utf_len = 0;
-static int utf_j = 0;
-
-/**
- * Clear the buffer where we collect pieces of a code point.
- * This is used for parser reset.
- */
-void ICACHE_FLASH_ATTR
-apars_reset_utf8buffer(void)
-{
-	utf_len = 0;
-	utf_j = 0;
-	memset(bytes, 0, 4);
-}
-
 //      Code Points      First Byte Second Byte Third Byte Fourth Byte
 //  U+0000 -   U+007F     00 - 7F
 //  U+0080 -   U+07FF     C2 - DF    80 - BF
@@ -40,6 +24,80 @@ apars_reset_utf8buffer(void)
 //	U+40000 -  U+FFFFF    F1 - F3    80 - BF     80 - BF    80 - BF
 //	U+100000 - U+10FFFF   F4         80 - *8F     80 - BF    80 - BF
 
+// Validating DFA (after Bjoern Hoehrmann's decoder). Bytes 0x80-0xFF are mapped
+// to character classes, the state is a row offset in the transition table.
+// Overlong forms, surrogates and code points above U+10FFFF are rejected.
+#define UTF8_ACCEPT 0
+#define UTF8_REJECT 12
+
+static const u8 utf8_class[128] ESP_CONST_DATA = {
+	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9, // 80-9F
+	7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, 7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7, // A0-BF
+	8,8,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, // C0-DF
+	10,3,3,3,3,3,3,3,3,3,3,3,3,4,3,3, 11,6,6,6,5,8,8,8,8,8,8,8,8,8,8,8, // E0-FF
+};
+
+static const u8 utf8_trans[108] ESP_CONST_DATA = {
+	0,12,24,36,60,96,84,12,12,12,48,72,  // start
+	12,12,12,12,12,12,12,12,12,12,12,12, // reject
+	12, 0,12,12,12,12,12, 0,12, 0,12,12, // 1 more (80-BF)
+	12,24,12,12,12,12,12,24,12,24,12,12, // 2 more (80-BF)
+	12,12,12,12,12,12,12,24,12,12,12,12, // after E0 (A0-BF)
+	12,24,12,12,12,12,12,12,12,24,12,12, // after ED (80-9F)
+	12,12,12,12,12,12,12,36,12,36,12,12, // after F0 (90-BF)
+	12,36,12,12,12,12,12,36,12,36,12,12, // after F1-F3 (80-BF)
+	12,36,12,12,12,12,12,12,12,12,12,12, // after F4 (80-8F)
+};
+
+static u8 utf_state = UTF8_ACCEPT;
+static u8 bytes[5]; // the code point's bytes, zero terminated when complete
+static u8 utf_j = 0;
+
+static void apars_utf8_reject(void);
+
+// Printable ASCII is collected here and written to the screen in runs
+#define PLAIN_RUN_LEN 64
+static char plain_run[PLAIN_RUN_LEN];
+static size_t plain_run_len = 0;
+
+/**
+ * Write the collected printable characters to the screen.
+ * This must be done before anything else touches the screen.
+ */
+void ICACHE_FLASH_ATTR
+apars_flush_plainchars(void)
+{
+	if (plain_run_len == 0) return;
+	screen_putchars(plain_run, plain_run_len);
+	plain_run_len = 0;
+}
+
+/**
+ * Write a run of printable ASCII characters (32-126) to the screen,
+ * bypassing the run buffer.
+ *
+ * @param buf - the characters
+ * @param len - number of characters
+ */
+void ICACHE_FLASH_ATTR
+apars_handle_plainchars(const char *buf, size_t len)
+{
+	apars_flush_plainchars();
+	if (utf_state != UTF8_ACCEPT) apars_utf8_reject();
+	screen_putchars(buf, len);
+}
+
+/**
+ * Clear the buffer where we collect pieces of a code point.
+ * This is used for parser reset.
+ */
+void ICACHE_FLASH_ATTR
+apars_reset_utf8buffer(void)
+{
+	utf_state = UTF8_ACCEPT;
+	utf_j = 0;
+}
+
 static void ICACHE_FLASH_ATTR screen_print_ascii(const char *str)
 {
 	char gly[2];
@@ -140,69 +198,54 @@ static void ICACHE_FLASH_ATTR hdump_bad(const char *ch, int len)
 
 
 /**
- * Handle a received plain character
- * @param c - received character
+ * Write U+FFFD in place of the collected bytes.
+ *
+ * Each maximal part of an ill-formed sequence (the bytes up to the first one
+ * that can't continue it, or a single byte that can't start a sequence) is
+ * replaced by one U+FFFD, as recommended by the Unicode standard.
  */
-void ICACHE_FLASH_ATTR
-apars_handle_plainchar(char c)
+static void ICACHE_FLASH_ATTR
+apars_utf8_reject(void)
 {
-	u8 uc = (u8)c;
-	// collecting unicode glyphs...
-	if (uc & 0x80) {
-		if (utf_len == 0) {
-			bytes[0] = uc;
-			utf_j = 1;
+	if (termconf_live.ascii_debug) {
+		hdump_bad((const char *) bytes, utf_j);
+	} else {
+		screen_putchar("\xEF\xBF\xBD");
+	}
+	apars_reset_utf8buffer();
+}
 
-			// start
-			if (uc == 0xC0 || uc == 0xC1 || uc > 0xF4) {
-				// forbidden start codes
-				goto fail;
-			}
-
-			if ((uc & 0xE0) == 0xC0) {
-				utf_len = 2;
-			}
-			else if ((uc & 0xF0) == 0xE0) {
-				utf_len = 3;
-			}
-			else if ((uc & 0xF8) == 0xF0) {
-				utf_len = 4;
-			}
-			else {
-				// chars over 127 that don't start unicode sequences
-				goto fail;
-			}
+/**
+ * Run a byte 0x80-0xFF through the DFA, write out the code point when complete.
+ *
+ * @param uc - received byte
+ */
+static void ICACHE_FLASH_ATTR
+apars_utf8_byte(u8 uc)
+{
+	const u8 class = utf8_class[uc - 0x80];
+	u8 next = utf8_trans[utf_state + class];
+
+	if (next == UTF8_REJECT) {
+		if (utf_state != UTF8_ACCEPT) {
+			// the unfinished sequence is cut short, the byte may start a new one
+			apars_utf8_reject();
+			next = utf8_trans[UTF8_ACCEPT + class];
 		}
-		else {
-			if ((uc & 0xC0) != 0x80) {
-				bytes[utf_j++] = uc;
-				goto fail;
-			}
-			else {
-				bytes[utf_j++] = uc;
-				if (utf_j >= utf_len) {
-					// check for bad sequences - overlong or some other problem
-					if (bytes[0] == 0xF4 && bytes[1] > 0x8F) goto fail;
-					if (bytes[0] == 0xF0 && bytes[1] < 0x90) goto fail;
-					if (bytes[0] == 0xED && bytes[1] > 0x9F) goto fail;
-					if (bytes[0] == 0xE0 && bytes[1] < 0xA0) goto fail;
-
-					// trap for surrogates - those break javascript
-					if (bytes[0] == 0xED && bytes[1] >= 0xA0 && bytes[1] <= 0xBF) goto fail;
-
-					if (termconf_live.ascii_debug) {
-						hdump_good((const char *) bytes);
-					} else {
-						screen_putchar((const char *) bytes);
-					}
-					apars_reset_utf8buffer();
-				}
-			}
+
+		if (next == UTF8_REJECT) {
+			bytes[0] = uc;
+			utf_j = 1;
+			apars_utf8_reject();
+			return;
 		}
 	}
-	else {
-		bytes[0] = uc;
-		bytes[1] = 0; // just to make sure it's closed...
+
+	bytes[utf_j++] = uc;
+	utf_state = next;
+
+	if (utf_state == UTF8_ACCEPT) {
+		bytes[utf_j] = 0;
 		if (termconf_live.ascii_debug) {
 			hdump_good((const char *) bytes);
 		} else {
@@ -210,15 +253,54 @@ apars_handle_plainchar(char c)
 		}
 		apars_reset_utf8buffer();
 	}
+}
 
-	return;
-fail:
+/**
+ * Handle a run of bytes 0x80-0xFF (UTF-8 sequences) received outside of escape sequences
+ *
+ * @param buf - the bytes
+ * @param len - number of bytes
+ */
+void ICACHE_FLASH_ATTR
+apars_handle_utf8(const char *buf, size_t len)
+{
+	apars_flush_plainchars();
+	for (size_t i = 0; i < len; i++) {
+		apars_utf8_byte((u8) buf[i]);
+	}
+}
+
+/**
+ * Handle a received plain character
+ * @param c - received character
+ */
+void ICACHE_FLASH_ATTR
+apars_handle_plainchar(char c)
+{
+	u8 uc = (u8)c;
+
+	if (uc >= SP && uc < DEL && !termconf_live.ascii_debug) {
+		// printable ASCII, this also ends an unfinished code point
+		if (utf_state != UTF8_ACCEPT) apars_utf8_reject();
+		plain_run[plain_run_len++] = c;
+		if (plain_run_len == PLAIN_RUN_LEN) apars_flush_plainchars();
+		return;
+	}
+
+	apars_flush_plainchars();
+
+	if (uc & 0x80) {
+		apars_utf8_byte(uc);
+		return;
+	}
+
+	if (utf_state != UTF8_ACCEPT) apars_utf8_reject();
+
+	bytes[0] = uc;
+	bytes[1] = 0;
 	if (termconf_live.ascii_debug) {
-		hdump_bad((const char *) bytes, utf_j);
+		hdump_good((const char *) bytes);
 	} else {
-		screen_putchar("\xEF\xBF\xBD");
+		screen_putchar((const char *) bytes);
 	}
-	//ansi_warn("BAD UTF8!");
-	//apars_show_context();
-	apars_reset_utf8buffer();
 }
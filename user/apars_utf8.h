@@ -5,7 +5,12 @@
 #ifndef ESP_VT100_FIRMWARE_APARS_UTF8_H
 #define ESP_VT100_FIRMWARE_APARS_UTF8_H
 
+#include <esp8266.h>
+
 void apars_handle_plainchar(char c);
+void apars_flush_plainchars(void);
+void apars_handle_plainchars(const char *buf, size_t len);
+void apars_handle_utf8(const char *buf, size_t len);
 void apars_reset_utf8buffer(void);
 
 #endif //ESP_VT100_FIRMWARE_APARS_UTF8_H
@@ -12,5 +12,6 @@
 #define API_PING    "/api/v1/ping"
 #define API_CLEAR   "/api/v1/clear"
 #define API_GPIO    "/api/v1/gpio"
+#define API_STATS   "/api/v1/stats"
 
 #endif //ESPTERM_API_H
@@ -345,7 +345,7 @@ postRecvHdl(HttpdConnData *connData, char *data, int len)
 	cgi_dbg("INI parse - end.");
 
 	// abort if bad screen size
-	bool tooLarge = (termconf->width*termconf->height > MAX_SCREEN_SIZE);
+	bool tooLarge = (termconf->width*termconf->height > MAX_SCREEN_SIZE) || (termconf->height > MAX_SCREEN_ROWS);
 	state->term_ok &= !tooLarge;
 	if (tooLarge) cgi_warn("Bad term screen size!");
 
@@ -8,36 +8,134 @@
 #include "ansi_parser.h"
 #include "jstring.h"
 #include "uart_driver.h"
+#include "cgi_system.h"
+#include "heatshrink_config_term.h"
+#include "heatshrink_encoder.h"
 
 // Heartbeat interval in ms
 #define HB_TIME 1000
 
+// Longest time a synchronized update can hold back the screen updates
+#define SYNC_UPDATE_TIMEOUT_MS 500
+
 // Buffer size (sent in one go)
 // Must be less than httpd sendbuf
 #define SOCK_BUF_LEN 2000
 
+// Largest update that is serialized in one piece (initial load snapshot, compressed update)
+#define UPDATE_HEAP_MAX_LEN 6000
+// Heap that must remain free after allocating it
+#define UPDATE_HEAP_RESERVE 8192
+// How long the snapshot is kept, if the screen doesn't change
+#define SNAPSHOT_KEEP_MS 3000
+
+// Shortest update that is worth compressing
+#define COMPRESS_MIN_LEN 512
+// Heatshrink window and lookahead size (log2), sent with each compressed update
+#define COMPRESS_WINDOW_SZ2 9
+#define COMPRESS_LOOKAHEAD_SZ2 5
+// Heap used by the encoder - input buffer of twice the window, and its index
+#define COMPRESS_ENCODER_HEAP (6 << COMPRESS_WINDOW_SZ2)
+// First byte of a compressed update
+#define COMPRESS_MARK 'Z'
+
 volatile ScreenNotifyTopics pendingBroadcastTopics = 0;
 
 // flags for screen update timeouts
 volatile bool notify_available = true;
 volatile bool notify_cooldown = false;
 volatile bool notify_scheduled = false;
+/** The update is waiting for the cooldown to end, the cooldown timer sends it */
+volatile bool notify_after_cooldown = false;
+
+/** Time of the oldest change not yet sent (system_get_time, us) */
+static u32 notify_pending_since;
+/** Time when the scheduled update fires (system_get_time, us) */
+static u32 notify_due;
+/** The scheduled time was cut short by the max latency limit */
+static bool notify_due_forced;
+
+NotifyStats notify_stats;
+
+/** Synchronized update in progress, screen updates are held back */
+volatile bool notify_hold = false;
 
 /** True if we sent XOFF to browser to stop uploading,
  * and we have to tell it we're ready again */
 volatile bool browser_wants_xon = false;
 
+/**
+ * Updates are serialized into this buffer one fragment at a time, and sent from it.
+ * It's static, a 2 kB array on the SDK task stack leaves too little for the callbacks it makes.
+ */
+static char sock_buff[SOCK_BUF_LEN];
+
 static ETSTimer updateNotifyTim;
 static ETSTimer notifyCooldownTim;
 static ETSTimer heartbeatTim;
+static ETSTimer syncTimeoutTim;
+static ETSTimer snapshotTim;
+
+/** Incremented on each screen change, used to tell if the snapshot is still valid */
+static u32 screen_generation = 0;
+
+/**
+ * The last initial load, serialized. Clients that connect
+ * while the screen is unchanged are sent a copy of it.
+ */
+static struct {
+	char *data; // NULL if none
+	size_t len;
+	u32 generation;
+	bool binary;
+	bool compress; // made for a client that accepts compressed updates
+	bool compressed; // the data is a compressed update
+	bool scroll; // made for a client that takes the scroll op
+} snapshot;
 
 volatile int term_active_clients = 0;
 
+/** Per-client state, stored in the socket's userData */
+typedef struct TermClient {
+	Websock *ws;
+	struct TermClient *next;
+	bool binary; // client asked for the binary update format
+	bool compress; // client accepts compressed updates
+	bool acks; // client acknowledges each update it processed
+	bool sending; // the update being sent is for this client too
+	u8 unacked; // updates sent and not yet acknowledged
+	bool synced; // had no content changes pending when the changes were last collected
+	ScreenNotifyTopics topics; // topics the client is subscribed to
+	ScreenNotifyTopics pending; // topics not yet sent to the client
+	ScreenDirty dirty; // screen changes not yet sent to the client
+} TermClient;
+
+/**
+ * Number of unacknowledged updates after which a client is considered lagging.
+ * It then collects the changes and gets them in one update when it catches up.
+ */
+#define CLIENT_MAX_UNACKED 2
+
+/** Client can be sent an update now (clients that don't use acks always can) */
+#define CLIENT_READY(cl) (!(cl)->acks || (cl)->unacked < CLIENT_MAX_UNACKED)
+
+/** Topics a client gets unless it asks for more. The debug topic and the scroll op are opt-in. */
+#define CLIENT_DEFAULT_TOPICS ((ScreenNotifyTopics) ~(TOPIC_INTERNAL | TOPIC_SCROLL | TOPIC_FLAG_BINARY | TOPIC_FLAG_NOCLEAN))
+
+/** Client takes the scroll op; the others are sent the scrolled region as redrawn rows */
+#define CLIENT_SCROLLS(cl) (((cl)->topics & TOPIC_SCROLL) != 0)
+
+/** Linked list of connected clients */
+static TermClient *term_clients = NULL;
+/** Union of the topics the connected clients are subscribed to */
+static ScreenNotifyTopics term_client_topics = 0;
+
 // we're trying to do a kind of mutex here, without the actual primitives
 // this might glitch, very rarely.
 // it's recommended to put some delay between setting labels and updating the screen.
 
 static void resetHeartbeatTimer(void);
+static void updateNotifyCb(void *arg);
 
 /**
  * Cooldown delay is over
@@ -47,48 +145,364 @@ static void ICACHE_FLASH_ATTR
 notifyCooldownTimCb(void *arg)
 {
 	notify_cooldown = false;
+
+	if (notify_after_cooldown) {
+		notify_after_cooldown = false;
+		updateNotifyCb(NULL);
+	}
+}
+
+/** Forget the changes a client was sent */
+static void ICACHE_FLASH_ATTR clientClearChanges(TermClient *cl)
+{
+	cl->pending = 0;
+	memset(&cl->dirty, 0, sizeof(ScreenDirty));
 }
 
 /**
- * Tell browser we have new content
- * @param arg
+ * Hand the changes recorded by the screen over to the clients.
+ * Each client collects them until it's sent an update.
+ * The screen's record must be reset with screen_dirty_reset() once the updates are sent.
+ */
+static void ICACHE_FLASH_ATTR collectChanges(void)
+{
+	ScreenNotifyTopics topics = pendingBroadcastTopics;
+	pendingBroadcastTopics = 0;
+
+	// the debug bar setting subscribes everyone to the debug topic, as in screen_notifyChange()
+	ScreenNotifyTopics forced = termconf_live.debugbar ? TOPIC_INTERNAL : 0;
+
+	for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+		cl->synced = !(cl->pending & (TOPIC_CHANGE_CONTENT_ALL | TOPIC_CHANGE_CONTENT_PART));
+		screen_dirty_merge(&cl->dirty);
+		if (!CLIENT_SCROLLS(cl)) screen_dirty_unscroll(&cl->dirty);
+		cl->pending |= topics & (cl->topics | forced);
+	}
+}
+
+/** Check if there's anything to send to a client that can receive it */
+static bool ICACHE_FLASH_ATTR updatePending(void)
+{
+	if (pendingBroadcastTopics != 0) return true;
+
+	for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+		if (cl->pending != 0 && CLIENT_READY(cl)) return true;
+	}
+	return false;
+}
+
+/**
+ * Send a message fragment
+ *
+ * @param ws - socket to send to; NULL to send to all clients marked as `sending`
  */
 static void ICACHE_FLASH_ATTR
-updateNotify_do(Websock *ws, ScreenNotifyTopics topics)
+sendFragment(Websock *ws, const char *buf, size_t len, int flags)
 {
+	if (ws) {
+		cgiWebsocketSend(ws, (char *) buf, (int) len, flags);
+		notify_stats.bytes += len;
+		return;
+	}
+
+	for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+		if (cl->sending) {
+			cgiWebsocketSend(cl->ws, (char *) buf, (int) len, flags);
+			notify_stats.bytes += len;
+		}
+	}
+}
+
+/**
+ * Send a message held in memory, split to SOCK_BUF_LEN fragments
+ *
+ * @param ws - socket to send to; NULL to send to all clients marked as `sending`
+ * @param flags - websocket flags of the message (binary or not)
+ */
+static void ICACHE_FLASH_ATTR
+sendMessage(Websock *ws, const char *data, size_t len, int flags)
+{
+	for (size_t i = 0; i < len; i += SOCK_BUF_LEN) {
+		size_t chunk = len - i;
+		int flg = flags;
+		if (chunk > SOCK_BUF_LEN) {
+			chunk = SOCK_BUF_LEN;
+			flg |= WEBSOCK_FLAG_MORE;
+		}
+		if (i > 0) flg |= WEBSOCK_FLAG_CONT;
+		sendFragment(ws, data + i, chunk, flg);
+	}
+}
+
+/**
+ * Serialize a screen update into a heap buffer
+ *
+ * @param topics - topics to serialize, including the flags
+ * @param dirty - changes to send, NULL if the topics include TOPIC_CHANGE_CONTENT_ALL
+ * @param out_len - the length is stored here
+ * @return the update (to be freed); NULL if it's longer than UPDATE_HEAP_MAX_LEN, or there's not enough heap
+ */
+static char * ICACHE_FLASH_ATTR
+serializeToHeap(ScreenNotifyTopics topics, const ScreenDirty *dirty, size_t *out_len)
+{
+	if (system_get_free_heap_size() < UPDATE_HEAP_MAX_LEN + UPDATE_HEAP_RESERVE) return NULL;
+	char *buf = malloc(UPDATE_HEAP_MAX_LEN);
+	if (buf == NULL) return NULL;
+
 	void *data = NULL;
-	char sock_buff[SOCK_BUF_LEN];
+	size_t len = 0, n;
+	httpd_cgi_state cont;
+	do {
+		cont = screenSerializeToBuffer(buf + len, UPDATE_HEAP_MAX_LEN - len, &n, topics, dirty, &data);
+		len += n;
+	} while (cont == HTTPD_CGI_MORE && n > 0);
+	screenSerializeToBuffer(NULL, 0, NULL, 0, NULL, &data);
+
+	if (cont == HTTPD_CGI_MORE) {
+		// does not fit
+		free(buf);
+		return NULL;
+	}
 
-	notify_available = false;
+	char *shrunk = realloc(buf, len);
+	*out_len = len;
+	return (shrunk != NULL) ? shrunk : buf;
+}
 
-	for (int i = 0; i < 20; i++) {
-		if (! ws) {
-			// broadcast
-			topics = pendingBroadcastTopics;
-			pendingBroadcastTopics = 0;
+/**
+ * Compress a serialized update with heatshrink.
+ * The result is COMPRESS_MARK, the window and lookahead size (log2, one byte each), and the compressed update.
+ *
+ * @param data - the update
+ * @param len - length of the update
+ * @param out_len - the compressed length is stored here
+ * @return the compressed update (to be freed); NULL if it's not shorter, or there's not enough heap
+ */
+static char * ICACHE_FLASH_ATTR
+compressUpdate(const char *data, size_t len, size_t *out_len)
+{
+	if (len < COMPRESS_MIN_LEN) return NULL;
+	if (system_get_free_heap_size() < len + COMPRESS_ENCODER_HEAP + UPDATE_HEAP_RESERVE) return NULL;
+
+	// if it doesn't fit in the length of the original, it's of no use
+	char *out = malloc(len);
+	if (out == NULL) return NULL;
+
+	heatshrink_encoder *hse = heatshrink_encoder_alloc(COMPRESS_WINDOW_SZ2, COMPRESS_LOOKAHEAD_SZ2);
+	if (hse == NULL) {
+		free(out);
+		return NULL;
+	}
+
+	out[0] = COMPRESS_MARK;
+	out[1] = COMPRESS_WINDOW_SZ2;
+	out[2] = COMPRESS_LOOKAHEAD_SZ2;
+
+	size_t sunk = 0, pos = 3, n;
+	bool done = false;
+	while (!done && pos < len) {
+		if (sunk < len) {
+			heatshrink_encoder_sink(hse, (uint8_t *) data + sunk, len - sunk, &n);
+			sunk += n;
+		} else {
+			done = (heatshrink_encoder_finish(hse) == HSER_FINISH_DONE);
+		}
+
+		HSE_poll_res pres;
+		do {
+			pres = heatshrink_encoder_poll(hse, (uint8_t *) out + pos, len - pos, &n);
+			pos += n;
+		} while (pres == HSER_POLL_MORE && pos < len);
+	}
+	heatshrink_encoder_free(hse);
+
+	if (!done) {
+		free(out);
+		return NULL;
+	}
+
+	char *shrunk = realloc(out, pos);
+	*out_len = pos;
+	return (shrunk != NULL) ? shrunk : out;
+}
+
+/**
+ * Serialize a screen update and send it
+ *
+ * @param ws - socket to send to; NULL to send to all clients marked as `sending`
+ * @param binary - use the binary format
+ * @param compress - compress the update if it's a full repaint and that makes it shorter
+ * @param topics - topics to serialize
+ * @param dirty - changes to send, NULL if the topics include TOPIC_CHANGE_CONTENT_ALL
+ */
+static void ICACHE_FLASH_ATTR
+updateNotify_send(Websock *ws, bool binary, bool compress, ScreenNotifyTopics topics, const ScreenDirty *dirty)
+{
+	void *data = NULL;
+	size_t len;
+
+	if (binary) topics |= TOPIC_FLAG_BINARY;
+	topics |= TOPIC_FLAG_NOCLEAN; // the screen's record was already handed over to the clients
+
+	if (compress && (topics & TOPIC_CHANGE_CONTENT_ALL)) {
+		char *msg = serializeToHeap(topics, dirty, &len);
+		if (msg != NULL) {
+			size_t zlen;
+			char *z = compressUpdate(msg, len, &zlen);
+			if (z != NULL) {
+				sendMessage(ws, z, zlen, WEBSOCK_FLAG_BIN);
+				free(z);
+			} else {
+				sendMessage(ws, msg, len, binary ? WEBSOCK_FLAG_BIN : 0);
+			}
+			free(msg);
+			return;
 		}
-		httpd_cgi_state cont = screenSerializeToBuffer(sock_buff, SOCK_BUF_LEN, topics, &data);
+		// too long to compress in one piece, send it as usual
+	}
 
-		int flg = 0; //WEBSOCK_FLAG_BIN
+	for (int i = 0; i < 20; i++) {
+		httpd_cgi_state cont = screenSerializeToBuffer(sock_buff, SOCK_BUF_LEN, &len, topics, dirty, &data);
+
+		int flg = binary ? WEBSOCK_FLAG_BIN : 0;
 		if (cont == HTTPD_CGI_MORE) flg |= WEBSOCK_FLAG_MORE;
 		if (i > 0) flg |= WEBSOCK_FLAG_CONT;
-		if (ws) {
-			cgiWebsocketSend(ws, sock_buff, (int) strlen(sock_buff), flg);
-		} else {
-			cgiWebsockBroadcast(URL_WS_UPDATE, sock_buff, (int) strlen(sock_buff), flg);
-			resetHeartbeatTimer();
-		}
+		sendFragment(ws, sock_buff, len, flg);
 		if (cont == HTTPD_CGI_DONE) break;
 
 		system_soft_wdt_feed();
 	}
 
 	// cleanup
-	screenSerializeToBuffer(NULL, 0, 0, &data);
+	screenSerializeToBuffer(NULL, 0, NULL, 0, NULL, &data);
+}
+
+/**
+ * Free the initial load snapshot
+ * @param arg
+ */
+static void ICACHE_FLASH_ATTR
+snapshotFreeCb(void *arg)
+{
+	if (snapshot.data != NULL) {
+		free(snapshot.data);
+		snapshot.data = NULL;
+	}
+}
+
+/**
+ * Send the initial load to a client, from the snapshot if it's up to date
+ *
+ * @param ws - socket to send to
+ * @param binary - use the binary format
+ * @param compress - the client accepts compressed updates
+ * @param topics - topics of the initial load, TOPIC_SCROLL if the client takes the scroll op
+ * @return false if there's no snapshot and it could not be created
+ */
+static bool ICACHE_FLASH_ATTR
+snapshotSend(Websock *ws, bool binary, bool compress, ScreenNotifyTopics topics)
+{
+	bool scroll = (topics & TOPIC_SCROLL) != 0;
+
+	if (snapshot.data == NULL || snapshot.generation != screen_generation
+		|| snapshot.binary != binary || snapshot.compress != compress || snapshot.scroll != scroll) {
+		snapshotFreeCb(NULL);
+
+		size_t len;
+		char *msg = serializeToHeap(topics | TOPIC_FLAG_NOCLEAN | (binary ? TOPIC_FLAG_BINARY : 0), NULL, &len);
+		if (msg == NULL) return false;
+
+		snapshot.compressed = false;
+		if (compress) {
+			size_t zlen;
+			char *z = compressUpdate(msg, len, &zlen);
+			if (z != NULL) {
+				free(msg);
+				msg = z;
+				len = zlen;
+				snapshot.compressed = true;
+			}
+		}
+
+		snapshot.data = msg;
+		snapshot.len = len;
+		snapshot.generation = screen_generation;
+		snapshot.binary = binary;
+		snapshot.compress = compress;
+		snapshot.scroll = scroll;
+	}
+
+	sendMessage(ws, snapshot.data, snapshot.len, (snapshot.binary || snapshot.compressed) ? WEBSOCK_FLAG_BIN : 0);
+
+	TIMER_START(&snapshotTim, snapshotFreeCb, SNAPSHOT_KEEP_MS, 0);
+	return true;
+}
+
+/**
+ * Tell browser we have new content
+ * @param ws - socket to send to (initial load); NULL to send the pending changes to all clients
+ * @param topics - topics to send, ignored for broadcast
+ */
+static void ICACHE_FLASH_ATTR
+updateNotify_do(Websock *ws, ScreenNotifyTopics topics)
+{
+	notify_available = false;
+
+	collectChanges();
+
+	if (ws) {
+		TermClient *cl = ws->userData;
+		// the full update supersedes anything collected so far
+		clientClearChanges(cl);
+		topics |= cl->topics & TOPIC_SCROLL;
+		if (!snapshotSend(ws, cl->binary, cl->compress, topics)) {
+			updateNotify_send(ws, cl->binary, cl->compress, topics, NULL);
+		}
+		if (cl->acks) cl->unacked++;
+	} else {
+		for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+			if (cl->pending == 0 || !CLIENT_READY(cl)) continue;
+
+			// Clients that are in sync get the same update, so it's serialized only once.
+			// The ones before this one were either handled already, or can't receive now.
+			for (TermClient *c2 = cl; c2 != NULL; c2 = c2->next) {
+				c2->sending = (c2 == cl) ||
+					(c2->pending == cl->pending && c2->binary == cl->binary && c2->synced == cl->synced
+					 && CLIENT_SCROLLS(c2) == CLIENT_SCROLLS(cl)
+					 && (c2->compress == cl->compress || !(cl->pending & TOPIC_CHANGE_CONTENT_ALL))
+					 && CLIENT_READY(c2) && screen_dirty_equal(&c2->dirty, &cl->dirty));
+			}
+
+			// clients that had the previous state can be sent just the cells that changed since
+			updateNotify_send(NULL, cl->binary, cl->compress,
+							  cl->pending | (cl->synced ? TOPIC_FLAG_SHADOW : 0), &cl->dirty);
+
+			for (TermClient *c2 = cl; c2 != NULL; c2 = c2->next) {
+				if (!c2->sending) continue;
+				c2->sending = false;
+				if (c2->acks) c2->unacked++;
+				if (c2 != cl) clientClearChanges(c2);
+			}
+			clientClearChanges(cl);
+		}
+		resetHeartbeatTimer();
+	}
+
+	// the shadow copy follows the screen only now, the updates were serialized against the old one
+	screen_dirty_reset();
 
 	notify_available = true;
 }
 
+/** Send the pending changes as soon as possible (still subject to the cooldown) */
+static void ICACHE_FLASH_ATTR notifyScheduleNow(void)
+{
+	notify_scheduled = true;
+	notify_due = system_get_time();
+	notify_due_forced = false;
+	TIMER_START(&updateNotifyTim, updateNotifyCb, 0, 0);
+}
+
 /**
  * Tell browser we have new content
  * @param arg
@@ -101,15 +515,52 @@ updateNotifyCb(void *arg)
 
 	inp_dbg("Notify broadcast +%02Xh?", pendingBroadcastTopics);
 
-	if (!notify_available || notify_cooldown || (max_bl > 2048)) { // do not send if we have anything significant backlogged
+	if (notify_hold) {
+		// it will be re-scheduled when the synchronized update ends
+		notify_scheduled = false;
+		return;
+	}
+
+	if (notify_cooldown) {
+		// sent as soon as the cooldown ends
+		notify_after_cooldown = true;
+		notify_stats.postponed++;
+		return;
+	}
+
+	// Clients that send acks are not sent more than they can take.
+	// For the others, we can only check the backlog of the slowest one.
+	bool acks_only = true;
+	for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+		if (!cl->acks) acks_only = false;
+	}
+
+	if (!notify_available || (!acks_only && max_bl > 2048)) { // do not send if we have anything significant backlogged
 		// postpone a little
 		TIMER_START(&updateNotifyTim, updateNotifyCb, 4, 0);
-		inp_dbg("postpone notify; avail? %d coold? %d maxbl? %d", notify_available, notify_cooldown, max_bl);
+		notify_stats.postponed++;
+		inp_dbg("postpone notify; avail? %d maxbl? %d", notify_available, max_bl);
+		return;
+	}
+
+	if (!updatePending()) {
+		// the lagging clients get their changes when they catch up
+		notify_scheduled = false;
 		return;
 	}
 
+	bool fresh = (pendingBroadcastTopics != 0);
+	u32 latency = (system_get_time() - notify_pending_since) / 1000;
+
 	updateNotify_do(arg, 0);
 
+	notify_stats.frames++;
+	if (fresh) {
+		notify_stats.latency_sum += latency;
+		if (latency > notify_stats.latency_max) notify_stats.latency_max = latency;
+	}
+	if (notify_due_forced) notify_stats.forced++;
+
 	notify_scheduled = false;
 	notify_cooldown = true;
 
@@ -146,20 +597,91 @@ notify_growl(char *msg)
  */
 void ICACHE_FLASH_ATTR screen_notifyChange(ScreenNotifyTopics topics)
 {
+	screen_generation++;
+
 	if (term_active_clients == 0) return;
 
+	// drop what nobody listens to, so it does not schedule a frame
+	// (the debug bar setting subscribes everyone to the debug topic)
+	topics &= term_client_topics | (termconf_live.debugbar ? TOPIC_INTERNAL : 0);
+	if (topics == 0) return;
+
 	inp_dbg("Notify +%02Xh", topics);
 
+	u32 now = system_get_time();
+	if (pendingBroadcastTopics == 0) {
+		notify_pending_since = now;
+	}
+
 	pendingBroadcastTopics |= topics;
 
-	int time = termconf->display_tout_ms;
+	if (notify_hold) return; // sent when the synchronized update ends
+	if (notify_after_cooldown) return; // already waiting for the cooldown to end
+
+	u32 time = termconf->display_tout_ms;
 	if (time == 0 && notify_scheduled) return; // do not reset the timer if already scheduled
 
+	// The debounce timer is pushed back by each change, but never past the max latency
+	// counted from the oldest pending change - otherwise a continuous stream would starve the clients.
+	u32 due = now + time * 1000;
+	u32 deadline = notify_pending_since + termconf->display_max_latency_ms * 1000;
+	bool forced = false;
+	if ((s32) (due - deadline) > 0) {
+		due = deadline;
+		forced = true;
+	}
+
+	if (notify_scheduled && (s32) (due - notify_due) <= 0) return; // would not fire any later
+
+	if ((s32) (due - now) < 0) {
+		time = 0;
+	} else {
+		time = (due - now) / 1000;
+	}
+
 	notify_scheduled = true;
+	notify_due = due;
+	notify_due_forced = forced;
 	// NOTE: the timer is restarted if already running
 	TIMER_START(&updateNotifyTim, updateNotifyCb, time, 0); // note - this adds latency to beep
 }
 
+/**
+ * Synchronized update took too long, the host probably forgot to end it
+ * @param arg
+ */
+static void ICACHE_FLASH_ATTR
+syncTimeoutCb(void *arg)
+{
+	inp_warn("Synchronized update timed out");
+	screen_notifyHold(false);
+}
+
+/**
+ * Begin or end a synchronized update.
+ * This is a callback for the Screen module.
+ * While active, changes are only collected. They are sent in one go
+ * when the update ends, or when it times out.
+ */
+void ICACHE_FLASH_ATTR screen_notifyHold(bool hold)
+{
+	if (hold == notify_hold) return;
+	notify_hold = hold;
+
+	inp_dbg("Notify hold %d", hold);
+
+	if (hold) {
+		TIMER_START(&syncTimeoutTim, syncTimeoutCb, SYNC_UPDATE_TIMEOUT_MS, 0);
+	} else {
+		os_timer_disarm(&syncTimeoutTim);
+
+		if (term_active_clients > 0 && updatePending()) {
+			// send the collected changes right away
+			notifyScheduleNow();
+		}
+	}
+}
+
 /**
  * mouse event rx
  * @param evt - event type: p, r, m
@@ -236,9 +758,57 @@ static void ICACHE_FLASH_ATTR sendMouseAction(char evt, int y, int x, int button
 	UART_SendAsync(buf, -1);
 }
 
+/** Recalculate the union of the clients' topic subscriptions */
+static void ICACHE_FLASH_ATTR updateClientTopics(void)
+{
+	ScreenNotifyTopics topics = 0;
+	for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+		topics |= cl->topics;
+	}
+
+	term_client_topics = topics;
+}
+
+/**
+ * Apply the options sent by a client with the initial load request
+ *
+ * @param ws - the client socket
+ * @param opts - option characters:
+ *               'b' = binary update format,
+ *               'd' = subscribe to the debug topic (also gets the runtime counters with each heartbeat, message 'S'),
+ *               'a' = the client acknowledges each update (message 'a') and can be sent catch-up updates,
+ *               'z' = the client accepts heatshrink compressed updates (binary message starting with 'Z'),
+ *               'r' = the client takes the scroll op (topic 'R'), instead of the scrolled rows being resent
+ * @param len - number of option characters
+ */
+static void ICACHE_FLASH_ATTR clientSetOptions(Websock *ws, const char *opts, int len)
+{
+	TermClient *cl = ws->userData;
+
+	cl->binary = false;
+	cl->acks = false;
+	cl->compress = false;
+	cl->unacked = 0;
+	cl->topics = CLIENT_DEFAULT_TOPICS;
+	for (int i = 0; i < len; i++) {
+		if (opts[i] == 'b') cl->binary = true;
+		else if (opts[i] == 'd') cl->topics |= TOPIC_INTERNAL;
+		else if (opts[i] == 'a') cl->acks = true;
+		else if (opts[i] == 'z') cl->compress = true;
+		else if (opts[i] == 'r') cl->topics |= TOPIC_SCROLL;
+	}
+
+	inp_dbg("Client uses %s format, acks %d, compression %d, scroll op %d",
+			cl->binary ? "binary" : "text", cl->acks, cl->compress, CLIENT_SCROLLS(cl));
+	updateClientTopics();
+}
+
 /** Socket received a message */
 static void ICACHE_FLASH_ATTR updateSockRx(Websock *ws, char *data, int len, int flags)
 {
+	TermClient *cl = ws->userData;
+	if (cl == NULL) return; // failed to init, being closed
+
 	// Add terminator if missing (seems to randomly happen)
 	data[len] = 0;
 
@@ -252,9 +822,8 @@ static void ICACHE_FLASH_ATTR updateSockRx(Websock *ws, char *data, int len, int
 		case 's':
 			// pass string verbatim
 			if (termconf_live.loopback) {
-				for (int i = 1; i < len; i++) {
-					ansi_parser(data[i]);
-				}
+				ansi_parser_feed(data + 1, (size_t) (len - 1));
+				ansi_parser_flush();
 			}
 			UART_SendAsync(data+1, -1);
 
@@ -278,10 +847,21 @@ static void ICACHE_FLASH_ATTR updateSockRx(Websock *ws, char *data, int len, int
 
 		case 'i':
 			// requests initial load
+			// it may be followed by option characters, see clientSetOptions()
 			inp_dbg("Client requests initial load");
+			clientSetOptions(ws, data + 1, len - 1);
 			updateNotify_do(ws, TOPIC_INITIAL|TOPIC_FLAG_NOCLEAN);
 			break;
 
+		case 'a':
+			// client processed an update
+			if (cl->unacked > 0) cl->unacked--;
+			if (cl->pending != 0 && CLIENT_READY(cl) && !notify_scheduled) {
+				// it has some catching up to do
+				notifyScheduleNow();
+			}
+			break;
+
 		case 'm':
 		case 'p':
 		case 'r':
@@ -301,6 +881,21 @@ static void ICACHE_FLASH_ATTR updateSockRx(Websock *ws, char *data, int len, int
 	}
 }
 
+/** Send the runtime counters (message 'S' + JSON) to the clients subscribed to the debug topic */
+static void ICACHE_FLASH_ATTR sendStats(void)
+{
+	int len = 0;
+	for (TermClient *cl = term_clients; cl != NULL; cl = cl->next) {
+		if (!(cl->topics & TOPIC_INTERNAL)) continue;
+
+		if (len == 0) {
+			sock_buff[0] = 'S';
+			len = 1 + buildStatsJson(sock_buff + 1);
+		}
+		cgiWebsocketSend(cl->ws, sock_buff, len, 0);
+	}
+}
+
 /** Send a heartbeat msg */
 static void ICACHE_FLASH_ATTR heartbeatTimCb(void *unused)
 {
@@ -312,9 +907,10 @@ static void ICACHE_FLASH_ATTR heartbeatTimCb(void *unused)
 
 			// Heartbeat packet - indicate we're still connected
 			// JS reloads the page if heartbeat is lost for a couple seconds
-			char buf[10];
-			sprintf(buf, ".%d", hbcnt++);
-			cgiWebsockBroadcast(URL_WS_UPDATE, buf, (int) strlen(buf), 0);
+			char buf[12];
+			int len = sprintf(buf, ".%u", hbcnt++);
+			cgiWebsockBroadcast(URL_WS_UPDATE, buf, len, 0);
+			sendStats();
 
 			// schedule next tick
 			TIMER_START(&heartbeatTim, heartbeatTimCb, HB_TIME, 0);
@@ -334,6 +930,18 @@ static void ICACHE_FLASH_ATTR resetHeartbeatTimer(void)
 
 static void ICACHE_FLASH_ATTR closeSockCb(Websock *ws)
 {
+	TermClient *cl = ws->userData;
+	if (cl == NULL) return; // failed to init, it was never counted
+
+	for (TermClient **pp = &term_clients; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == cl) {
+			*pp = cl->next;
+			break;
+		}
+	}
+	free(cl);
+	ws->userData = NULL;
+
 	term_active_clients--;
 	inp_dbg("Close socket CB, remain %d clients", term_active_clients);
 	if (term_active_clients <= 0) {
@@ -346,7 +954,11 @@ static void ICACHE_FLASH_ATTR closeSockCb(Websock *ws)
 		// stop the timer
 		os_timer_disarm(&heartbeatTim);
 		inp_dbg("Stop HB timer");
+
+		screen_shadow_discard();
 	}
+
+	updateClientTopics();
 }
 
 /** Socket connected for updates */
@@ -356,6 +968,20 @@ void ICACHE_FLASH_ATTR updateSockConnect(Websock *ws)
 	ws->recvCb = updateSockRx;
 	ws->closeCb = closeSockCb;
 
+	TermClient *cl = malloc(sizeof(TermClient));
+	ws->userData = cl;
+	if (cl == NULL) {
+		error("Failed to alloc client state");
+		cgiWebsocketClose(ws, 1011); // internal error
+		return;
+	}
+
+	memset(cl, 0, sizeof(TermClient));
+	cl->ws = ws;
+	cl->topics = CLIENT_DEFAULT_TOPICS;
+	cl->next = term_clients;
+	term_clients = cl;
+
 	if (term_active_clients == 0) {
 		if (mouse_tracking.focus_tracking) {
 			UART_SendAsync("\x1b[I", 3);
@@ -365,6 +991,7 @@ void ICACHE_FLASH_ATTR updateSockConnect(Websock *ws)
 	}
 
 	term_active_clients++;
+	updateClientTopics();
 }
 
 ETSTimer xonTim;
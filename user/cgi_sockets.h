@@ -17,6 +17,18 @@ void notify_growl(char *msg);
 
 extern volatile int term_active_clients;
 
+/** Screen update scheduler counters (since boot) */
+typedef struct {
+	u32 frames;      //!< screen update frames broadcast
+	u32 bytes;       //!< update bytes handed to the sockets, counted for each client
+	u32 latency_sum; //!< sum of the frame latencies (oldest change to sending), ms
+	u32 latency_max; //!< longest frame latency, ms
+	u32 forced;      //!< frames sent early due to the max latency limit
+	u32 postponed;   //!< sending postponed due to cooldown or backlog
+} NotifyStats;
+
+extern NotifyStats notify_stats;
+
 // defined in the makefile
 #if DEBUG_INPUT
 #define inp_warn warn
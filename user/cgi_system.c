@@ -8,6 +8,8 @@
 #include "syscfg.h"
 #include "ansi_parser.h"
 #include "cgi_logging.h"
+#include "cgi_sockets.h"
+#include "uart_buffer.h"
 
 #define SET_REDIR_SUC "/cfg/system"
 
@@ -387,3 +389,56 @@ tplGpio(HttpdConnData *connData, char *token, void **arg)
 {
 	return tplSystemCfg(connData, token, arg);
 }
+
+/**
+ * Build a JSON with the runtime counters (UART, parser, screen updates),
+ * for sizing the buffers and baud rate of a particular setup.
+ *
+ * @param buff - target, STATS_JSON_MAX_LEN long
+ * @return length of the JSON
+ */
+int ICACHE_FLASH_ATTR
+buildStatsJson(char *buff)
+{
+	return sprintf(buff,
+		"{\"uart\":{\"rx\":%u,\"rx_dropped\":%u,\"tx\":%u,\"tx_dropped\":%u,"
+		"\"frame_errors\":%u,\"fifo_overflows\":%u,\"rx_paused\":%u,"
+		"\"rx_high_water\":%u,\"rx_size\":%u,\"tx_high_water\":%u,\"tx_size\":%u},"
+		"\"parser\":{\"chars\":%u,\"errors\":%u},"
+		"\"updates\":{\"clients\":%d,\"frames\":%u,\"bytes\":%u,"
+		"\"forced\":%u,\"postponed\":%u,\"latency_max\":%u},"
+		"\"heap\":%u}",
+		uart_stats.rx_bytes, uart_stats.rx_dropped, uart_stats.tx_bytes, uart_stats.tx_dropped,
+		uart_stats.frame_errors, uart_stats.fifo_overflows, uart_stats.rx_paused,
+		uart_stats.rx_high_water, UART_RX_BUFFER_SIZE, uart_stats.tx_high_water, UART_TX_BUFFER_SIZE,
+		ansi_parser_char_cnt, ansi_parser_error_cnt,
+		term_active_clients, notify_stats.frames, notify_stats.bytes,
+		notify_stats.forced, notify_stats.postponed, notify_stats.latency_max,
+		system_get_free_heap_size()
+	);
+}
+
+/**
+ * API to read the runtime counters
+ *
+ * @param connData
+ * @return
+ */
+httpd_cgi_state ICACHE_FLASH_ATTR cgiStats(HttpdConnData *connData)
+{
+	char buff[STATS_JSON_MAX_LEN];
+
+	if (connData->conn==NULL) {
+		//Connection aborted. Clean up.
+		return HTTPD_CGI_DONE;
+	}
+
+	httpdStartResponse(connData, 200);
+	httpdHeader(connData, "Content-Type", "application/json");
+	httpdEndHeaders(connData);
+
+	int len = buildStatsJson(buff);
+	httpdSend(connData, buff, len);
+
+	return HTTPD_CGI_DONE;
+}
@@ -11,5 +11,11 @@ httpd_cgi_state tplSystemCfg(HttpdConnData *connData, char *token, void **arg);
 httpd_cgi_state cgiResetScreen(HttpdConnData *connData);
 httpd_cgi_state cgiGPIO(HttpdConnData *connData);
 httpd_cgi_state tplGpio(HttpdConnData *connData, char *token, void **arg);
+httpd_cgi_state cgiStats(HttpdConnData *connData);
+
+/** Buffer size needed by buildStatsJson() */
+#define STATS_JSON_MAX_LEN 512
+
+int buildStatsJson(char *buff);
 
 #endif // CGI_PING_H
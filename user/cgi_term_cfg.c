@@ -47,7 +47,7 @@ cgiTermCfgSetParams(HttpdConnData *connData)
 
 	// width and height must always go together so we can do max size validation
 	u32 siz = termconf->width*termconf->height;
-	if (siz == 0 || siz > MAX_SCREEN_SIZE) {
+	if (siz == 0 || siz > MAX_SCREEN_SIZE || termconf->height > MAX_SCREEN_ROWS) {
 		cgi_warn("Bad dimensions: %d x %d (total %d)", termconf->width, termconf->height, termconf->width*termconf->height);
 		redir_url += sprintf(redir_url, "term_width,term_height,");
 	}
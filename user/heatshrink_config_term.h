@@ -0,0 +1,21 @@
+//
+// Heatshrink configuration for the screen update compression.
+// Included ahead of the library headers, so it replaces their default config.
+//
+
+#ifndef HEATSHRINK_CONFIG_H
+#define HEATSHRINK_CONFIG_H
+
+#include <esp8266.h>
+
+// The encoder is allocated only while compressing, parameters are given at runtime
+#define HEATSHRINK_DYNAMIC_ALLOC 1
+#define HEATSHRINK_MALLOC(SZ) malloc(SZ)
+#define HEATSHRINK_FREE(P, SZ) free(P)
+
+#define HEATSHRINK_DEBUGGING_LOGS 0
+
+// Faster compression, the index takes two bytes per byte of the input buffer
+#define HEATSHRINK_USE_INDEX 1
+
+#endif // HEATSHRINK_CONFIG_H
@@ -0,0 +1,7 @@
+//
+// Heatshrink encoder, used to compress large screen updates (see cgi_sockets.c).
+// The library is shipped with libesphttpd, only its decoder is built there (for espfs).
+//
+
+#include "heatshrink_config_term.h"
+#include "../libesphttpd/lib/heatshrink/heatshrink_encoder.c"
@@ -17,15 +17,16 @@ MouseTrackingConfig mouse_tracking;
 
 // forward declare
 static void utf8_remap(char* out, char g, char charset);
+static inline void clear_range_utf(unsigned int from, unsigned int to);
 
 #define W termconf_live.width
 #define H termconf_live.height
 
 /**
- * Screen cell data type (16 bits)
+ * Screen cell data type
  */
 typedef struct __attribute__((packed)) {
-	UnicodeCacheRef symbol : 8;
+	UnicodeCacheRef symbol;
 	Color fg;
 	Color bg;
 	CellAttrs attrs;
@@ -36,10 +37,28 @@ typedef struct __attribute__((packed)) {
  */
 static Cell screen[MAX_SCREEN_SIZE];
 
+/**
+ * Row map - logical row number to a row in the screen data array.
+ * Scrolling only rotates this table, the cells stay in place.
+ */
+static u8 row_map[MAX_SCREEN_ROWS];
+
+/**
+ * Number of unicode cache references in each row of the screen data array.
+ * Rows without any can skip the reference counting when cleared or moved.
+ */
+static u16 row_utf_count[MAX_SCREEN_ROWS];
+
+/** Get the first cell of a row */
+#define ROW(y) (screen + row_map[(y)] * W)
+/** Get the unicode reference count of a row */
+#define ROW_UTF(y) row_utf_count[row_map[(y)]]
+/** Get a cell by its coordinates */
+#define CELL(y, x) (ROW(y) + (x))
 
 
 #define TABSTOP_WORDS 5
-#define LINE_ATTRS_COUNT 64
+#define LINE_ATTRS_COUNT MAX_SCREEN_ROWS
 /**
  * Screen state structure
  */
@@ -129,8 +148,21 @@ static struct {
 	int vm0;
 	int vm1;
 	u32 tab_stops[TABSTOP_WORDS];
+
+	// main screen content, allocated when switching to alternate if there's enough RAM
+	Cell *cells; // width*height cells, rows in logical order
+	char (*glyphs)[4]; // bytes of the unicode symbols in the cells, by UNICODE_CACHE_REF_INDEX(); NULL if none
+	u16 row_utf[MAX_SCREEN_ROWS];
+	u8 line_attribs[LINE_ATTRS_COUNT];
 } state_backup;
 
+/**
+ * Free heap that must remain after allocating the main screen backup.
+ * The backup holds no unicode cache references, so the alternate screen can use the whole cache.
+ * Its symbols are kept as bytes and added to the cache again when it's restored.
+ */
+#define ALT_SCREEN_HEAP_RESERVE 8192
+
 /** options backup (save/restore) */
 static struct {
 	bool cursors_alt_mode;
@@ -155,27 +187,296 @@ static struct {
 static volatile int notifyLock = 0;
 static volatile ScreenNotifyTopics lockTopics = 0;
 
-static struct {
-	int x_min, y_min, x_max, y_max;
-} scr_dirty;
+/**
+ * Changes not yet sent to the browser.
+ * Clients that lag behind keep their own copy, see screen_dirty_merge().
+ */
+static ScreenDirty scr_dirty;
 
 static void ICACHE_FLASH_ATTR reset_screen_dirty(void)
 {
-	scr_dirty.x_min = W;
-	scr_dirty.x_max = -1;
-	scr_dirty.y_min = H;
-	scr_dirty.y_max = -1;
+	memset(scr_dirty.rows, 0, sizeof(scr_dirty.rows));
+	scr_dirty.scroll_lines = 0;
+}
+
+static void ICACHE_FLASH_ATTR dirty_expand(ScreenDirty *d, int y0, int y1, int x0, int x1)
+{
+	if (y0 < 0) y0 = 0;
+	if (y1 >= MAX_SCREEN_ROWS) y1 = MAX_SCREEN_ROWS - 1;
+
+	for (int y = y0; y <= y1; y++) {
+		if (!ROW_IS_DIRTY(d->rows, y)) {
+			d->rows[y/32] |= (1u << (y % 32));
+			d->x_min[y] = (u16) x0;
+			d->x_max[y] = (u16) x1;
+		} else {
+			if (x0 < d->x_min[y]) d->x_min[y] = (u16) x0;
+			if (x1 > d->x_max[y]) d->x_max[y] = (u16) x1;
+		}
+	}
 }
 
 static void ICACHE_FLASH_ATTR expand_dirty(int y0, int y1, int x0, int x1)
 {
-	seri_dbg("Expand: X: (%d..%d) -> %d..%d, Y: (%d..%d) -> %d..%d",
-			 scr_dirty.x_min, scr_dirty.x_max, x0, x1, scr_dirty.y_min, scr_dirty.y_max, y0, y1);
+	seri_dbg("Expand: X: %d..%d, Y: %d..%d", x0, x1, y0, y1);
+	dirty_expand(&scr_dirty, y0, y1, x0, x1);
+}
+
+/**
+ * Move the dirty state of a row to another row (used when scrolling)
+ */
+static void ICACHE_FLASH_ATTR dirty_move_row(ScreenDirty *d, int dest, int src)
+{
+	if (ROW_IS_DIRTY(d->rows, src)) {
+		d->rows[dest/32] |= (1u << (dest % 32));
+		d->x_min[dest] = d->x_min[src];
+		d->x_max[dest] = d->x_max[src];
+	} else {
+		d->rows[dest/32] &= ~(1u << (dest % 32));
+	}
+}
+
+/**
+ * Add a region scroll to the changes, so it can be sent as a scroll op instead of the whole region.
+ * The dirty rows inside the region are shifted with the content and the exposed rows are marked dirty.
+ *
+ * @param d - changes to update
+ * @param top - first row of the region
+ * @param btm - last row of the region
+ * @param lines - number of lines, positive - up, negative - down
+ */
+static void ICACHE_FLASH_ATTR dirty_scroll(ScreenDirty *d, int top, int btm, int lines)
+{
+	int total = d->scroll_lines + lines;
+
+	if ((d->scroll_lines != 0 &&
+		 (d->scroll_top != top || d->scroll_btm != btm || (d->scroll_lines > 0) != (lines > 0)))
+		|| total >= (btm - top + 1) || -total >= (btm - top + 1)) {
+		// can't merge with the pending scroll, or it covers everything - resend the region
+		dirty_expand(d, top, btm, 0, W - 1);
+		return;
+	}
+
+	if (lines > 0) {
+		for (int y = top; y <= btm - lines; y++) {
+			dirty_move_row(d, y, y + lines);
+		}
+		for (int y = btm - lines + 1; y <= btm; y++) {
+			d->rows[y/32] &= ~(1u << (y % 32));
+		}
+		dirty_expand(d, btm - lines + 1, btm, 0, W - 1);
+	} else {
+		for (int y = btm; y >= top - lines; y--) {
+			dirty_move_row(d, y, y + lines);
+		}
+		for (int y = top; y < top - lines; y++) {
+			d->rows[y/32] &= ~(1u << (y % 32));
+		}
+		dirty_expand(d, top, top - lines - 1, 0, W - 1);
+	}
 
-	if ((y0) < scr_dirty.y_min) scr_dirty.y_min  = (y0);
-	if ((x0) < scr_dirty.x_min) scr_dirty.x_min  = (x0);
-	if ((y1) > scr_dirty.y_max) scr_dirty.y_max  = (y1);
-	if ((x1) > scr_dirty.x_max) scr_dirty.x_max  = (x1);
+	d->scroll_top = top;
+	d->scroll_btm = btm;
+	d->scroll_lines = total;
+}
+
+/**
+ * Record a region scroll of the screen
+ */
+static void ICACHE_FLASH_ATTR record_scroll(int top, int btm, int lines)
+{
+	seri_dbg("Scroll: Y %d..%d by %d (pending %d)", top, btm, lines, scr_dirty.scroll_lines);
+	dirty_scroll(&scr_dirty, top, btm, lines);
+}
+
+/**
+ * Merge the changes recorded since the last screen_dirty_reset() into a client's copy.
+ * The result is as if the client was sent its old changes followed by the new ones.
+ */
+void ICACHE_FLASH_ATTR
+screen_dirty_merge(ScreenDirty *into)
+{
+	if (scr_dirty.scroll_lines != 0) {
+		dirty_scroll(into, scr_dirty.scroll_top, scr_dirty.scroll_btm, scr_dirty.scroll_lines);
+	}
+
+	for (int y = 0; y < H; y++) {
+		if (ROW_IS_DIRTY(scr_dirty.rows, y)) {
+			dirty_expand(into, y, y, scr_dirty.x_min[y], scr_dirty.x_max[y]);
+		}
+	}
+}
+
+/**
+ * Copy of the screen as it was at the last screen_dirty_reset(), i.e. what the clients
+ * that are in sync have. The serializer uses it to skip the unchanged cells inside
+ * the dirty extents. It holds its own unicode cache references, which are given up
+ * when the cache is full (see cache_add_symbol()).
+ */
+static struct {
+	Cell *cells; // width*height cells, rows in logical order; NULL if not allocated
+	u32 width;
+	u32 height;
+	bool valid; // false if the screen changed in a way not covered by the dirty extents
+} shadow;
+
+/** Free heap that must remain after allocating the shadow copy (on top of room for the alt screen backup) */
+#define SHADOW_HEAP_RESERVE ALT_SCREEN_HEAP_RESERVE
+
+/** Release the shadow copy's unicode references, leaving it blank and invalid */
+static void ICACHE_FLASH_ATTR shadow_release(void)
+{
+	if (shadow.cells == NULL) return;
+
+	for (u32 i = 0; i < shadow.width * shadow.height; i++) {
+		if (IS_UNICODE_CACHE_REF(shadow.cells[i].symbol)) {
+			unicode_cache_remove(shadow.cells[i].symbol);
+			shadow.cells[i].symbol = ' ';
+		}
+	}
+	shadow.valid = false;
+}
+
+/**
+ * Add a symbol to the unicode cache. When it's full, the shadow copy may hold the last
+ * references to symbols no longer on the screen - those are released and the add is retried.
+ * The shadow is then resynchronized in full with the next update.
+ */
+static UnicodeCacheRef ICACHE_FLASH_ATTR cache_add_symbol(const u8 *bytes)
+{
+	UnicodeCacheRef ref = unicode_cache_add(bytes);
+	if (ref == '?' && bytes[0] >= 127 && shadow.cells != NULL) {
+		shadow_release();
+		ref = unicode_cache_add(bytes);
+	}
+	return ref;
+}
+
+/** Free the shadow copy, e.g. when there's no client to use it */
+void ICACHE_FLASH_ATTR
+screen_shadow_discard(void)
+{
+	shadow_release();
+	free(shadow.cells);
+	shadow.cells = NULL;
+}
+
+/** Copy a span of a row from the screen to the shadow */
+static void ICACHE_FLASH_ATTR shadow_copy_span(int y, int x0, int x1)
+{
+	Cell *dest = shadow.cells + y * W;
+	for (int x = x0; x <= x1; x++) {
+		const Cell *src = CELL(y, x);
+		if (dest[x].symbol != src->symbol) {
+			if (IS_UNICODE_CACHE_REF(src->symbol)) unicode_cache_inc(src->symbol);
+			if (IS_UNICODE_CACHE_REF(dest[x].symbol)) unicode_cache_remove(dest[x].symbol);
+		}
+		dest[x] = *src;
+	}
+}
+
+/** Reverse the order of shadow rows a..b */
+static void ICACHE_FLASH_ATTR shadow_reverse_rows(int a, int b)
+{
+	for (; a < b; a++, b--) {
+		Cell *ra = shadow.cells + a * W;
+		Cell *rb = shadow.cells + b * W;
+		for (u32 x = 0; x < W; x++) {
+			Cell tmp = ra[x];
+			ra[x] = rb[x];
+			rb[x] = tmp;
+		}
+	}
+}
+
+/**
+ * Bring the shadow copy up to date using the recorded changes.
+ * The scrolled region is rotated, so no references are lost; the exposed rows are dirty.
+ */
+static void ICACHE_FLASH_ATTR shadow_sync(void)
+{
+	if (shadow.cells != NULL && (shadow.width != W || shadow.height != H)) {
+		screen_shadow_discard();
+	}
+
+	if (shadow.cells == NULL) {
+		size_t cells_size = W * H * sizeof(Cell);
+		// the alternate screen backup takes priority, leave room for it
+		if (system_get_free_heap_size() < cells_size * 2 + SHADOW_HEAP_RESERVE) return;
+
+		shadow.cells = malloc(cells_size);
+		if (shadow.cells == NULL) return;
+
+		for (u32 i = 0; i < W * H; i++) {
+			shadow.cells[i] = (Cell) {.symbol = ' '};
+		}
+		shadow.width = W;
+		shadow.height = H;
+		shadow.valid = false;
+	}
+
+	if (!shadow.valid) {
+		for (int y = 0; y < H; y++) {
+			shadow_copy_span(y, 0, W - 1);
+		}
+		shadow.valid = true;
+		return;
+	}
+
+	int lines = scr_dirty.scroll_lines;
+	if (lines != 0) {
+		int top = scr_dirty.scroll_top;
+		int btm = scr_dirty.scroll_btm;
+		// rotate the region rows; scrolling down by N is the same as up by (height - N)
+		if (lines < 0) lines += btm - top + 1;
+		shadow_reverse_rows(top, top + lines - 1);
+		shadow_reverse_rows(top + lines, btm);
+		shadow_reverse_rows(top, btm);
+	}
+
+	for (int y = 0; y < H; y++) {
+		if (ROW_IS_DIRTY(scr_dirty.rows, y)) {
+			shadow_copy_span(y, scr_dirty.x_min[y], scr_dirty.x_max[y]);
+		}
+	}
+}
+
+/**
+ * Turn a pending scroll into a redraw of the whole region, for a client that doesn't take the scroll op.
+ * The rows shifted by dirty_scroll() lie inside the region, so they are covered, too.
+ */
+void ICACHE_FLASH_ATTR
+screen_dirty_unscroll(ScreenDirty *d)
+{
+	if (d->scroll_lines == 0) return;
+
+	dirty_expand(d, d->scroll_top, d->scroll_btm, 0, W - 1);
+	d->scroll_lines = 0;
+}
+
+/**
+ * Forget the changes recorded by the screen, after they were merged into all clients
+ * and the clients that were in sync were sent their update.
+ */
+void ICACHE_FLASH_ATTR
+screen_dirty_reset(void)
+{
+	shadow_sync();
+	reset_screen_dirty();
+}
+
+/** Compare two sets of changes, ignoring the spans of clean rows */
+bool ICACHE_FLASH_ATTR
+screen_dirty_equal(const ScreenDirty *a, const ScreenDirty *b)
+{
+	if (a->scroll_lines != b->scroll_lines) return false;
+	if (a->scroll_lines != 0 && (a->scroll_top != b->scroll_top || a->scroll_btm != b->scroll_btm)) return false;
+	if (memcmp(a->rows, b->rows, sizeof(a->rows)) != 0) return false;
+
+	for (int y = 0; y < H; y++) {
+		if (ROW_IS_DIRTY(a->rows, y) && (a->x_min[y] != b->x_min[y] || a->x_max[y] != b->x_max[y])) return false;
+	}
+	return true;
 }
 
 #define NOTIFY_LOCK() { notifyLock++; }
@@ -183,6 +484,7 @@ static void ICACHE_FLASH_ATTR expand_dirty(int y0, int y1, int x0, int x1)
 static void ICACHE_FLASH_ATTR NOTIFY_DONE(u32 updateTopics)
 {
 	lockTopics |= (updateTopics);
+	if (updateTopics & TOPIC_CHANGE_CONTENT_ALL) shadow.valid = false;
 	if (notifyLock > 0) notifyLock--;
 	if (notifyLock == 0) {
 		screen_notifyChange(lockTopics);
@@ -397,6 +699,7 @@ terminal_restore_defaults(void)
 	termconf->backdrop[0] = 0;
 	termconf->font_stack[0] = 0;
 	termconf->font_size = 20;
+	termconf->display_max_latency_ms = SCR_DEF_DISPLAY_MAX_LATENCY_MS;
 }
 
 /**
@@ -456,6 +759,11 @@ terminal_apply_settings_noclear(void)
 		termconf->bc1 = termconf->bc2 = termconf->bc3 = termconf->bc4 = termconf->bc5 = 0;
 		changed = 1;
 	}
+	if (termconf->config_version < 7) {
+		persist_dbg("termconf: Updating to version 7");
+		termconf->display_max_latency_ms = SCR_DEF_DISPLAY_MAX_LATENCY_MS;
+		changed = 1;
+	}
 
 	termconf->config_version = TERMCONF_VERSION;
 
@@ -466,7 +774,7 @@ terminal_apply_settings_noclear(void)
 	}
 
 	memcpy(&termconf_live, termconf, sizeof(TerminalConfigBundle));
-	if (W*H > MAX_SCREEN_SIZE) {
+	if (W*H > MAX_SCREEN_SIZE || H > MAX_SCREEN_ROWS) {
 		error("BAD SCREEN SIZE: %d rows x %d cols", H, W);
 		error("reverting terminal settings to default");
 		terminal_restore_defaults();
@@ -483,6 +791,18 @@ terminal_apply_settings_noclear(void)
 
 //region --- Reset / Init ---
 
+/**
+ * Free the saved main screen content (if any)
+ */
+static void ICACHE_FLASH_ATTR
+alt_backup_discard(void)
+{
+	free(state_backup.cells);
+	state_backup.cells = NULL;
+	free(state_backup.glyphs);
+	state_backup.glyphs = NULL;
+}
+
 /**
  * Init the screen (entire mappable area - for consistency)
  */
@@ -492,6 +812,7 @@ screen_init(void)
 	if(DEBUG_HEAP) dbg("Screen buffer size = %d bytes", sizeof(screen));
 
 	reset_screen_dirty();
+	shadow.valid = false;
 	screen_reset();
 }
 
@@ -577,6 +898,10 @@ screen_reset_do(bool size, bool labels)
 	scr.reverse_video = false;
 
 	state_backup.alternate_active = false;
+	alt_backup_discard();
+
+	// end a synchronized update, if any
+	screen_notifyHold(false);
 
 	mouse_tracking.encoding = MTE_SIMPLE;
 	mouse_tracking.focus_tracking = false;
@@ -675,7 +1000,40 @@ screen_swap_state(bool alternate)
 		// remember old size. may have to resize when returning
 		state_backup.width = W;
 		state_backup.height = H;
-		// TODO backup screen content (if this is ever possible)
+
+		// save the screen content, if there's enough RAM for it
+		size_t cells_size = W * H * sizeof(Cell);
+		bool has_utf = false;
+		for (int y = 0; y < H && !has_utf; y++) {
+			has_utf = ROW_UTF(y) != 0;
+		}
+		size_t glyphs_size = has_utf ? UNICODE_CACHE_SIZE * sizeof(*state_backup.glyphs) : 0;
+		if (system_get_free_heap_size() > cells_size + glyphs_size + ALT_SCREEN_HEAP_RESERVE) {
+			state_backup.cells = malloc(cells_size);
+			if (state_backup.cells != NULL && glyphs_size != 0) {
+				state_backup.glyphs = malloc(glyphs_size);
+				if (state_backup.glyphs == NULL) alt_backup_discard();
+			}
+		}
+
+		if (state_backup.cells != NULL) {
+			for (int y = 0; y < H; y++) {
+				Cell *row = ROW(y);
+				memcpy(state_backup.cells + y * W, row, W * sizeof(Cell));
+				state_backup.row_utf[y] = ROW_UTF(y);
+
+				// the symbols are kept as bytes, the references are released with the screen content
+				if (ROW_UTF(y) == 0) continue;
+				for (int x = 0; x < W; x++) {
+					if (IS_UNICODE_CACHE_REF(row[x].symbol)) {
+						unicode_cache_retrieve(row[x].symbol, (u8 *) state_backup.glyphs[UNICODE_CACHE_REF_INDEX(row[x].symbol)]);
+					}
+				}
+			}
+			memcpy(state_backup.line_attribs, scr.line_attribs, sizeof(scr.line_attribs));
+		} else {
+			ansi_warn("Not enough RAM to save the screen");
+		}
 	}
 	else {
 		ansi_dbg("Unswap from alternate");
@@ -690,7 +1048,26 @@ screen_swap_state(bool alternate)
 		scr.vm1 = state_backup.vm1;
 		// this may clear the screen as a side effect if size changed
 		screen_resize(state_backup.height, state_backup.width);
-		// TODO restore screen content (if this is ever possible)
+
+		if (state_backup.cells != NULL) {
+			// release the alternate screen content, then add the saved symbols to the cache again
+			clear_range_utf(0, W * H - 1);
+			for (int y = 0; y < H; y++) {
+				Cell *row = ROW(y);
+				memcpy(row, state_backup.cells + y * W, W * sizeof(Cell));
+				ROW_UTF(y) = state_backup.row_utf[y];
+
+				if (ROW_UTF(y) == 0) continue;
+				for (int x = 0; x < W; x++) {
+					if (!IS_UNICODE_CACHE_REF(row[x].symbol)) continue;
+					row[x].symbol = cache_add_symbol((const u8 *) state_backup.glyphs[UNICODE_CACHE_REF_INDEX(row[x].symbol)]);
+					if (!IS_UNICODE_CACHE_REF(row[x].symbol)) ROW_UTF(y)--; // cache full, shown as '?'
+				}
+			}
+			memcpy(scr.line_attribs, state_backup.line_attribs, sizeof(scr.line_attribs));
+
+			alt_backup_discard();
+		}
 	}
 
 	state_backup.alternate_active = alternate;
@@ -866,6 +1243,7 @@ static void ICACHE_FLASH_ATTR
 clear_range_do(unsigned int from, unsigned int to, bool clear_utf)
 {
 	if (to >= W*H) to = W*H-1;
+	if (from > to) return;
 
 	Cell sample;
 	sample.symbol = ' ';
@@ -879,12 +1257,25 @@ clear_range_do(unsigned int from, unsigned int to, bool clear_utf)
 		sample.fg = sample.bg = 0;
 	}
 
-	for (unsigned int i = from; i <= to; i++) {
-		if (clear_utf) {
-			UnicodeCacheRef symbol = screen[i].symbol;
-			if (IS_UNICODE_CACHE_REF(symbol)) unicode_cache_remove(symbol);
+	unsigned int y = from / W;
+	unsigned int x = from % W;
+	unsigned int y1 = to / W;
+	unsigned int x1;
+	for (; y <= y1; y++, x = 0) {
+		x1 = (y == y1) ? (to % W) : (W - 1);
+		Cell *row = ROW(y);
+		if (ROW_UTF(y) != 0) {
+			for (unsigned int i = x; i <= x1; i++) {
+				UnicodeCacheRef symbol = row[i].symbol;
+				if (IS_UNICODE_CACHE_REF(symbol)) {
+					if (clear_utf) unicode_cache_remove(symbol);
+					ROW_UTF(y)--;
+				}
+			}
+		}
+		for (; x <= x1; x++) {
+			memcpy(&row[x], &sample, sizeof(Cell));
 		}
-		memcpy(&screen[i], &sample, sizeof(Cell));
 	}
 }
 
@@ -922,9 +1313,11 @@ static inline void ICACHE_FLASH_ATTR
 utf_free_cell(int row, int col)
 {
 	//dbg("free cell (row %d) %d", row, col);
-	UnicodeCacheRef symbol = screen[row * W + col].symbol;
-	if (IS_UNICODE_CACHE_REF(symbol))
+	UnicodeCacheRef symbol = CELL(row, col)->symbol;
+	if (IS_UNICODE_CACHE_REF(symbol)) {
 		unicode_cache_remove(symbol);
+		ROW_UTF(row)--;
+	}
 }
 
 /**
@@ -938,9 +1331,11 @@ static inline void ICACHE_FLASH_ATTR
 utf_backup_cell(int row, int col)
 {
 	//dbg("backup cell (row %d) %d", row, col);
-	UnicodeCacheRef symbol = screen[row * W + col].symbol;
-	if (IS_UNICODE_CACHE_REF(symbol))
+	UnicodeCacheRef symbol = CELL(row, col)->symbol;
+	if (IS_UNICODE_CACHE_REF(symbol)) {
 		unicode_cache_inc(symbol);
+		ROW_UTF(row)++;
+	}
 }
 
 /**
@@ -953,70 +1348,72 @@ static inline void ICACHE_FLASH_ATTR
 copy_cell(int row, int dest_col, int src_col)
 {
 	//dbg("copy cell (row %d) %d -> %d", row, src_col, dest_col);
-	memcpy(screen+row*W+dest_col, screen+row*W+src_col, sizeof(Cell));
+	memcpy(CELL(row, dest_col), CELL(row, src_col), sizeof(Cell));
 }
 
 /**
- * Free all utf8 on a row
+ * Clear a row, freeing any utf8 refs
  *
  * @param row
  */
 static inline void ICACHE_FLASH_ATTR
-utf_free_row(int row)
+clear_row_utf(int row)
 {
-	//dbg("free row %d", row);
-	for (int col = 0; col < W; col++) {
-		utf_free_cell(row, col);
-	}
+	clear_range_utf(row * W, (row + 1) * W - 1);
 }
 
 /**
- * Back-up all utf8 refs on a row
+ * Shift a block of rows upwards, clearing the rows that come in at the bottom.
+ * Only the row map is rotated, the cells are not moved.
  *
- * @param row
+ * @param y0 - first row of the block
+ * @param y1 - last row of the block
+ * @param lines - number of lines to shift by, must be less than the block height
  */
-static inline void ICACHE_FLASH_ATTR
-utf_backup_row(int row)
+static void ICACHE_FLASH_ATTR
+shift_rows_up(int y0, int y1, int lines)
 {
-	//dbg("backup row %d", row);
-	for (int col = 0; col < W; col++) {
-		utf_backup_cell(row, col);
+	u8 tmp[MAX_SCREEN_ROWS];
+	int moved = y1 - y0 + 1 - lines;
+
+	memcpy(tmp, &row_map[y0], (size_t) lines);
+	memmove(&row_map[y0], &row_map[y0 + lines], (size_t) moved);
+	memcpy(&row_map[y0 + moved], tmp, (size_t) lines);
+
+	memmove(&scr.line_attribs[y0], &scr.line_attribs[y0 + lines], (size_t) moved);
+	memset(&scr.line_attribs[y0 + moved], 0, (size_t) lines);
+
+	// the recycled rows still hold the old content
+	for (int y = y0 + moved; y <= y1; y++) {
+		clear_row_utf(y);
 	}
 }
 
 /**
- * Duplicate a row
+ * Shift a block of rows downwards, clearing the rows that come in at the top.
+ * Only the row map is rotated, the cells are not moved.
  *
- * @param dest - destination row number (0-based)
- * @param src  - source row number (0-based)
+ * @param y0 - first row of the block
+ * @param y1 - last row of the block
+ * @param lines - number of lines to shift by, must be less than the block height
  */
-static inline void ICACHE_FLASH_ATTR
-copy_row(int dest, int src)
+static void ICACHE_FLASH_ATTR
+shift_rows_down(int y0, int y1, int lines)
 {
-	//dbg("copy row %d -> %d", src, dest);
-	memcpy(screen + dest * W, screen + src * W, sizeof(Cell) * W);
-}
+	u8 tmp[MAX_SCREEN_ROWS];
+	int moved = y1 - y0 + 1 - lines;
 
-/**
- * Clear a row, do nothing with the utf8 cache
- *
- * @param row
- */
-static inline void ICACHE_FLASH_ATTR
-clear_row_noutf(int row)
-{
-	clear_range_noutf(row * W, (row + 1) * W - 1);
-}
+	memcpy(tmp, &row_map[y0 + moved], (size_t) lines);
+	memmove(&row_map[y0 + lines], &row_map[y0], (size_t) moved);
+	memcpy(&row_map[y0], tmp, (size_t) lines);
 
-/**
- * Clear a row, freeing any utf8 refs
- *
- * @param row
- */
-static inline void ICACHE_FLASH_ATTR
-clear_row_utf(int row)
-{
-	clear_range_utf(row * W, (row + 1) * W - 1);
+	memmove(&scr.line_attribs[y0 + lines], &scr.line_attribs[y0], (size_t) moved);
+	memset(&scr.line_attribs[y0], 0, (size_t) lines);
+
+	// the recycled rows still hold the old content
+	for (int y = y0; y < y0 + lines; y++) {
+		clear_row_utf(y);
+	}
 }
 
 /**
@@ -1029,7 +1426,11 @@ screen_clear(ClearMode mode)
 	NOTIFY_LOCK();
 	switch (mode) {
 		case CLEAR_ALL:
+			// the shadow is resynchronized in full after this
+			shadow_release();
 			unicode_cache_clear();
+			memset(row_utf_count, 0, sizeof(row_utf_count));
+			for (int i = 0; i < MAX_SCREEN_ROWS; i++) row_map[i] = (u8) i;
 			clear_range_noutf(0, W * H - 1);
 			scr.last_char[0]  = 0;
 			for (int i = 0; i < LINE_ATTRS_COUNT; i++) scr.line_attribs[i] = 0;
@@ -1105,19 +1506,7 @@ screen_insert_lines(unsigned int lines)
 		}
 	} else {
 		// do the moving
-		for (int i = BTM; i >= targetStart; i--) {
-			utf_free_row(i); // release old characters
-			copy_row(i, i - lines);
-			scr.line_attribs[i] = scr.line_attribs[i-lines];
-			if (i != targetStart) utf_backup_row(i);
-		}
-
-		// clear the first line
-		clear_row_noutf(cursor.y);
-		// copy it to the rest of the cleared region
-		for (int i = cursor.y+1; i < targetStart; i++) {
-			copy_row(i, cursor.y);
-		}
+		shift_rows_down(cursor.y, BTM, lines);
 	}
 	expand_dirty(cursor.y, BTM, 0, W - 1);
 	NOTIFY_DONE(TOPIC_CHANGE_CONTENT_PART|TOPIC_DOUBLE_LINES);
@@ -1140,17 +1529,7 @@ screen_delete_lines(unsigned int lines)
 		}
 	} else {
 		// move some lines up, clear the rest
-		for (int i = cursor.y; i <= movedBlockEnd; i++) {
-			utf_free_row(i);
-			copy_row(i, i+lines);
-			scr.line_attribs[i] = scr.line_attribs[i+lines];
-			if (i != movedBlockEnd) utf_backup_row(i);
-		}
-		clear_range_noutf((movedBlockEnd+1)*W, (BTM+1)*W-1);
-
-		for (int i = movedBlockEnd+1; i <= BTM; i++) {
-			scr.line_attribs[i] = 0;
-		}
+		shift_rows_up(cursor.y, BTM, lines);
 	}
 
 	expand_dirty(cursor.y, BTM, 0, W - 1);
@@ -1170,10 +1549,15 @@ screen_insert_characters(unsigned int count)
 		clear_range_utf(cursor.y * W + cursor.x, (cursor.y + 1) * W - 1);
 	} else {
 		// do the moving
-		for (int i = W-1; i >= targetStart; i--) {
-			utf_free_cell(cursor.y, i);
-			copy_cell(cursor.y, i, i - count);
-			utf_backup_cell(cursor.y, i);
+		if (ROW_UTF(cursor.y) == 0) {
+			// no unicode in the row, just move the cells
+			memmove(CELL(cursor.y, targetStart), CELL(cursor.y, cursor.x), (W - targetStart) * sizeof(Cell));
+		} else {
+			for (int i = W-1; i >= targetStart; i--) {
+				utf_free_cell(cursor.y, i);
+				copy_cell(cursor.y, i, i - count);
+				utf_backup_cell(cursor.y, i);
+			}
 		}
 		clear_range_utf(cursor.y * W + cursor.x, cursor.y * W + targetStart - 1);
 	}
@@ -1191,14 +1575,18 @@ screen_delete_characters(unsigned int count)
 	int movedBlockEnd = W - count;
 	if (movedBlockEnd > cursor.x) {
 		// partial line delete / move
-
-		for (int i = cursor.x; i <= movedBlockEnd; i++) {
-			utf_free_cell(cursor.y, i);
-			copy_cell(cursor.y, i, i + count);
-			utf_backup_cell(cursor.y, i);
+		if (ROW_UTF(cursor.y) == 0) {
+			// no unicode in the row, just move the cells
+			memmove(CELL(cursor.y, cursor.x), CELL(cursor.y, cursor.x + count), (movedBlockEnd - cursor.x) * sizeof(Cell));
+		} else {
+			for (int i = cursor.x; i < movedBlockEnd; i++) {
+				utf_free_cell(cursor.y, i);
+				copy_cell(cursor.y, i, i + count);
+				utf_backup_cell(cursor.y, i);
+			}
 		}
 		// clear original positions of the moved characters
-		clear_range_noutf(cursor.y * W + (W - count), (cursor.y + 1) * W - 1);
+		clear_range_utf(cursor.y * W + movedBlockEnd, (cursor.y + 1) * W - 1);
 	} else {
 		// all rest was cleared
 		screen_clear_line(CLEAR_FROM_CURSOR);
@@ -1244,13 +1632,16 @@ screen_resize(int rows, int cols)
 		return;
 	}
 
-	if (cols * rows > MAX_SCREEN_SIZE) {
+	if (cols * rows > MAX_SCREEN_SIZE || rows > MAX_SCREEN_ROWS) {
 		error("Too big size: %d x %d", cols, rows);
 		return;
 	}
 
 	if (W == cols && H == rows) return; // Do nothing
 
+	// the saved main screen can't be restored at a different size
+	alt_backup_discard();
+
 	NOTIFY_LOCK();
 	W = (u32) cols;
 	H = (u32) rows;
@@ -1364,6 +1755,7 @@ screen_scroll_up(unsigned int lines)
 		for (int i = TOP; i <= BTM; i++) {
 			scr.line_attribs[i] = 0;
 		}
+		expand_dirty(TOP, BTM, 0, W - 1);
 		goto done;
 	}
 
@@ -1372,22 +1764,11 @@ screen_scroll_up(unsigned int lines)
 		goto done;
 	}
 
-	int y;
-	for (y = TOP; y <= BTM - lines; y++) {
-		utf_free_row(y);
-		copy_row(y, y+lines);
-		scr.line_attribs[y] = scr.line_attribs[y+lines];
-		if (y < BTM - lines) utf_backup_row(y);
-	}
-
-	clear_range_noutf(y * W, (BTM + 1) * W - 1);
-	for (int i = y; i <= BTM; i++) {
-		scr.line_attribs[i] = 0;
-	}
+	shift_rows_up(TOP, BTM, lines);
+	record_scroll(TOP, BTM, lines);
 
 done:
-	expand_dirty(TOP, BTM, 0, W - 1);
-	NOTIFY_DONE(TOPIC_CHANGE_CONTENT_PART|TOPIC_DOUBLE_LINES);
+	NOTIFY_DONE(TOPIC_SCROLL|TOPIC_CHANGE_CONTENT_PART|TOPIC_DOUBLE_LINES);
 }
 
 /**
@@ -1403,6 +1784,7 @@ screen_scroll_down(unsigned int lines)
 		for (int i = TOP; i <= BTM; i++) {
 			scr.line_attribs[i] = 0;
 		}
+		expand_dirty(TOP, BTM, 0, W - 1);
 		goto done;
 	}
 
@@ -1411,21 +1793,11 @@ screen_scroll_down(unsigned int lines)
 		goto done;
 	}
 
-	int y;
-	for (y = BTM; y >= TOP+lines; y--) {
-		utf_free_row(y);
-		copy_row(y, y-lines);
-		scr.line_attribs[y] = scr.line_attribs[y-lines];
-		if (y > TOP + lines) utf_backup_row(y);
-	}
+	shift_rows_down(TOP, BTM, lines);
+	record_scroll(TOP, BTM, -(int)lines);
 
-	clear_range_noutf(TOP * W, (TOP + lines) * W - 1);
-	for (int i = TOP; i < TOP + lines; i++) {
-		scr.line_attribs[i] = 0;
-	}
 done:
-	expand_dirty(TOP, BTM, 0, W - 1);
-	NOTIFY_DONE(TOPIC_CHANGE_CONTENT_PART|TOPIC_DOUBLE_LINES);
+	NOTIFY_DONE(TOPIC_SCROLL|TOPIC_CHANGE_CONTENT_PART|TOPIC_DOUBLE_LINES);
 }
 
 /** Set scrolling region */
@@ -1643,10 +2015,6 @@ screen_cursor_move(int dy, int dx, bool scroll)
 		}
 	}
 
-	if (scrolled) {
-		expand_dirty(TOP, BTM, 0, W-1);
-	}
-
 	NOTIFY_DONE(TOPIC_CHANGE_CURSOR | (scrolled*TOPIC_CHANGE_CONTENT_PART));
 }
 
@@ -1869,6 +2237,12 @@ screen_set_bracketed_paste(bool ena)
 	NOTIFY_DONE(TOPIC_CHANGE_SCREEN_OPTS);
 }
 
+void ICACHE_FLASH_ATTR
+screen_set_synchronized_update(bool ena)
+{
+	screen_notifyHold(ena);
+}
+
 void ICACHE_FLASH_ATTR
 screen_set_newline_mode(bool nlm)
 {
@@ -2020,7 +2394,7 @@ putchar_graphic(const char *ch)
 		}
 	}
 
-	Cell *c = &screen[cursor.x + cursor.y * W];
+	Cell *c = CELL(cursor.y, cursor.x);
 
 	// move the rest of the line if we're in Insert Mode
 	if (cursor.x < W-1 && scr.insert_mode) screen_insert_characters(1);
@@ -2037,13 +2411,24 @@ putchar_graphic(const char *ch)
 	Color oldBg = c->bg;
 	CellAttrs oldAttrs = c->attrs;
 
-	unicode_cache_remove(c->symbol);
-	c->symbol = unicode_cache_add((const u8 *)ch);
+	// the slot freed here can be handed right back to a different symbol, so keep the old bytes to compare
+	u8 oldBytes[4] = {0};
+	if (IS_UNICODE_CACHE_REF(oldSymbol)) unicode_cache_retrieve(oldSymbol, oldBytes);
+
+	if (IS_UNICODE_CACHE_REF(c->symbol)) {
+		unicode_cache_remove(c->symbol);
+		ROW_UTF(cursor.y)--;
+	}
+	c->symbol = cache_add_symbol((const u8 *)ch);
+	if (IS_UNICODE_CACHE_REF(c->symbol)) ROW_UTF(cursor.y)++;
 	c->fg = cursor.fg;
 	c->bg = cursor.bg;
 	c->attrs = cursor.attrs;
 
-	if (c->symbol != oldSymbol || c->fg != oldFg || c->bg != oldBg || c->attrs != oldAttrs) {
+	bool symbolChanged = c->symbol != oldSymbol
+		|| (IS_UNICODE_CACHE_REF(oldSymbol) && strncmp((const char *) oldBytes, ch, 4) != 0);
+
+	if (symbolChanged || c->fg != oldFg || c->bg != oldBg || c->attrs != oldAttrs) {
 		expand_dirty(cursor.y, cursor.y, cursor.x, cursor.x);
 		topics |= TOPIC_CHANGE_CONTENT_PART;
 	}
@@ -2113,6 +2498,112 @@ done:
 	return;
 }
 
+/**
+ * Write a run of printable ASCII characters in the cursor color, with wrap.
+ * Same effect as screen_putchar() for each of them, but each row is written
+ * in one pass with a single dirty span update and notification.
+ *
+ * @param buf - characters 32-126
+ * @param len - number of characters
+ */
+void ICACHE_FLASH_ATTR
+screen_putchars(const char *buf, size_t len)
+{
+	char gly[2];
+	gly[1] = 0;
+
+	if (len == 0) return;
+
+	NOTIFY_LOCK();
+	ScreenNotifyTopics topics = TOPIC_CHANGE_CURSOR;
+
+	char chs = (cursor.charsetN == 0) ? cursor.charset0 : cursor.charset1;
+	if (scr.insert_mode || chs != CS_B_USASCII) {
+		// those need per-character processing
+		while (len > 0) {
+			gly[0] = *buf++;
+			len--;
+			screen_putchar(gly);
+		}
+		goto done;
+	}
+
+	while (len > 0) {
+		// clear "hanging" flag if not possible
+		clear_invalid_hanging();
+
+		if (cursor.hanging) {
+			if (cursor.auto_wrap) {
+				cursor.x = 0;
+				cursor.y++;
+				// Y wrap
+				if (cursor.y > BTM) {
+					// Scroll up, so we have space for writing
+					screen_scroll_up(1);
+					cursor.y = BTM;
+				}
+
+				cursor.hanging = false;
+			} else {
+				// without wrap, each char overwrites the last one - only the last char matters
+				buf += len - 1;
+				len = 1;
+			}
+		}
+
+		if (IS_DOUBLE_WIDTH()) {
+			// rare, let the generic function handle the shortened line
+			gly[0] = *buf++;
+			len--;
+			screen_putchar(gly);
+			continue;
+		}
+
+		int n = W - cursor.x;
+		if ((size_t) n > len) n = (int) len;
+
+		Cell *c = CELL(cursor.y, cursor.x);
+		int x0 = -1, x1 = -1; // changed span
+		for (int k = 0; k < n; k++, c++) {
+			UnicodeCacheRef symbol = (UnicodeCacheRef) (cursor.conceal ? ' ' : buf[k]);
+			if (c->symbol != symbol || c->fg != cursor.fg || c->bg != cursor.bg || c->attrs != cursor.attrs) {
+				if (IS_UNICODE_CACHE_REF(c->symbol)) {
+					unicode_cache_remove(c->symbol);
+					ROW_UTF(cursor.y)--;
+				}
+				c->symbol = symbol;
+				c->fg = cursor.fg;
+				c->bg = cursor.bg;
+				c->attrs = cursor.attrs;
+
+				if (x0 < 0) x0 = cursor.x + k;
+				x1 = cursor.x + k;
+			}
+		}
+
+		if (x0 >= 0) {
+			expand_dirty(cursor.y, cursor.y, x0, x1);
+			topics |= TOPIC_CHANGE_CONTENT_PART;
+		}
+
+		buf += n;
+		len -= n;
+		cursor.x += n;
+		// X wrap
+		if (cursor.x >= W) {
+			cursor.hanging = true; // hanging - next typed char wraps around, but backspace and arrows still stay on the same line.
+			cursor.x = W - 1;
+		}
+	}
+
+	// Remember the last character for the Repeat command
+	scr.last_char[0] = (char) (cursor.conceal ? ' ' : buf[-1]);
+	scr.last_char[1] = 0;
+
+done:
+	NOTIFY_DONE(topics);
+}
+
 /**
  * Repeat last graphic character
  * @param count
@@ -2204,28 +2695,119 @@ struct ScreenSerializeState {
 	ScreenNotifyTopics last_topic;
 	ScreenNotifyTopics current_topic;
 	bool partial;
-	int x_min, x_max, y_min, y_max;
+	int x_min, x_max, y_min, y_max; // the patch currently being sent
 	int i_max;
-	int i_start;
+	bool patch_begun;
 	bool first;
+	bool binary; // binary message format
+	bool shadow; // cells the client already has are skipped, see TOPIC_FLAG_SHADOW
+	int scroll_top, scroll_btm, scroll_lines; // scroll op sent ahead of the patches
+	// copy of the dirty extents taken when the serialization started
+	u32 dirty_rows[DIRTY_ROW_WORDS];
+	u16 dirty_x_min[MAX_SCREEN_ROWS];
+	u16 dirty_x_max[MAX_SCREEN_ROWS];
 };
 
+/** Shortest run of unchanged cells that is sent as a skip, shorter ones cost less to resend */
+#define SERI_SKIP_MIN 3
+
+/**
+ * Get the shadow copy of a cell as the client has it after applying the scroll op
+ *
+ * @return the cell, NULL if the row was exposed by the scroll or the shadow was released
+ */
+static inline const Cell * ICACHE_FLASH_ATTR
+seri_shadow_cell(struct ScreenSerializeState *ss, int y, int x)
+{
+	if (!shadow.valid) return NULL; // released to make room in the unicode cache
+	if (ss->scroll_lines != 0 && y >= ss->scroll_top && y <= ss->scroll_btm) {
+		y += ss->scroll_lines;
+		if (y < ss->scroll_top || y > ss->scroll_btm) return NULL;
+	}
+	return shadow.cells + y * W + x;
+}
+
+/**
+ * Find the next dirty patch, starting at a given row.
+ * Consecutive rows with identical column spans are merged into one rectangle.
+ *
+ * @param ss - serializer state, the patch bounds are written here
+ * @param y - first row to inspect
+ * @return true if a patch was found
+ */
+static bool ICACHE_FLASH_ATTR
+seri_next_patch(struct ScreenSerializeState *ss, int y)
+{
+	for (; y < H; y++) {
+		if (ROW_IS_DIRTY(ss->dirty_rows, y)) break;
+	}
+	if (y >= H) return false;
+
+	ss->y_min = ss->y_max = y;
+	ss->x_min = ss->dirty_x_min[y];
+	ss->x_max = ss->dirty_x_max[y];
+	if (ss->x_max >= W) ss->x_max = W - 1;
+
+	while (ss->y_max + 1 < H
+		   && ROW_IS_DIRTY(ss->dirty_rows, ss->y_max + 1)
+		   && ss->dirty_x_min[ss->y_max + 1] == ss->dirty_x_min[y]
+		   && ss->dirty_x_max[ss->y_max + 1] == ss->dirty_x_max[y]) {
+		ss->y_max++;
+	}
+
+	ss->i_max = ss->y_max * W + ss->x_max;
+	ss->index = W * ss->y_min + ss->x_min;
+	ss->patch_begun = false;
+	seri_dbg("Patch X %d..%d, Y %d..%d", ss->x_min, ss->x_max, ss->y_min, ss->y_max);
+	return true;
+}
+
+/**
+ * Encode a number as a little-endian base-128 varint (used by the binary message format).
+ * The low 7 bits of each byte carry the value, the top bit marks that more bytes follow.
+ *
+ * @param out - output buffer, must have space for 5 bytes
+ * @param num - number to encode
+ * @return number of bytes written
+ */
+static u8 ICACHE_FLASH_ATTR
+varint_encode(char *out, u32 num)
+{
+	u8 n = 0;
+	while (num >= 0x80) {
+		out[n++] = (char) ((num & 0x7F) | 0x80);
+		num >>= 7;
+	}
+	out[n++] = (char) num;
+	return n;
+}
+
 /**
  * Serialize the screen to a data buffer. May need multiple calls if the buffer is insufficient in size.
  *
+ * Two message formats are supported:
+ * - text (default): numbers are encoded as UTF-8 code points offset by 1, strings are terminated by 0x01
+ * - binary (TOPIC_FLAG_BINARY): numbers are varints, strings are prefixed by their length as a varint
+ *
+ * The structure (topic marks, sequence tags, cell symbols as UTF-8) is the same in both.
+ * The output is not NUL-terminated, use the length given in `out_len`.
+ *
  * @warning MAKE SURE *DATA IS NULL BEFORE FIRST CALL!
  *          Call with NULL 'buffer' at the end to free the data struct.
  *
  * @param buffer - buffer array of limited size. If NULL, indicates this is the last call.
  * @param buf_len - buffer array size
+ * @param out_len - the number of bytes written to the buffer is stored here
  * @param topics - what should be included in the message (ignored after the first call)
+ * @param dirty - changes to send with TOPIC_CHANGE_CONTENT_PART (ignored after the first call);
+ *                if NULL, the screen's own record is used and cleaned, unless TOPIC_FLAG_NOCLEAN is given
  * @param data - opaque pointer to internal data structure for storing state between repeated calls
  *               if NULL, indicates this is the first call; the structure will be allocated.
  *
  * @return HTTPD_CGI_DONE or HTTPD_CGI_MORE. If more, repeat with the same `data` pointer.
  */
 httpd_cgi_state ICACHE_FLASH_ATTR
-screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics, void **data)
+screenSerializeToBuffer(char *buffer, size_t buf_len, size_t *out_len, ScreenNotifyTopics topics, const ScreenDirty *dirty, void **data)
 {
 	struct ScreenSerializeState *ss = *data;
 
@@ -2246,26 +2828,41 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 			remain--; \
 		} while(0)
 
-#define bufput_utf8(num) do { \
-		nbytes = utf8_encode(bb, (num)+1, true); \
+#define bufput_num(num) do { \
+		if (ss->binary) { \
+			nbytes = varint_encode(bb, (u32) (num)); \
+		} else { \
+			nbytes = utf8_encode(bb, (num)+1, true); \
+		} \
 		bb += nbytes; \
 		remain -= nbytes; \
 	} while(0)
 
-#define bufput_t_utf8(t, num) do { \
+#define bufput_t_num(t, num) do { \
 		bufput_c((t)); \
-		bufput_utf8((num)); \
+		bufput_num((num)); \
 	} while(0)
 
-#define bufput_color_utf8(c) do { \
-		if ((c) < 256) { \
-			bufput_utf8(c); \
+#define bufput_color(c) do { \
+		if ((c) < 256 || ss->binary) { \
+			bufput_num(c); \
 		} else { \
-			bufput_utf8((((c)-256)&0xFFF) | 0x10000); \
-			bufput_utf8((((c)-256)>>12)&0xFFF); \
+			bufput_num((((c)-256)&0xFFF) | 0x10000); \
+			bufput_num((((c)-256)>>12)&0xFFF); \
 		} \
 	} while(0)
 
+#define bufput_str(str) do { \
+		size_t slen = strlen((str)); \
+		if (ss->binary) bufput_num(slen); \
+		if (slen > 0) { \
+			memcpy(bb, (str), slen); \
+			bb += slen; \
+			remain -= slen; \
+		} \
+		if (!ss->binary) bufput_c('\x01'); \
+	} while(0)
+
 	// tags for screen serialization
 #define SEQ_TAG_SKIP '\x01'
 #define SEQ_TAG_REPEAT '\x02'
@@ -2285,37 +2882,41 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 #define TOPICMARK_SCREEN   'S'
 #define TOPICMARK_BACKDROP 'W'
 #define TOPICMARK_DBL_LINE 'H'
+#define TOPICMARK_SCROLL   'R'
 
 	if (ss == NULL) {
 		// START!
 
 		*data = ss = malloc(sizeof(struct ScreenSerializeState));
 
+		// the screen's own changes are cleaned here, a client's copy is managed by the caller
+		bool own_dirty = (dirty == NULL);
+		if (own_dirty) dirty = &scr_dirty;
+
 		if (topics == 0 || termconf_live.debugbar) {
 			topics |= TOPIC_INTERNAL;
 		}
 
+		// a client's copy is unscrolled by the caller if the client doesn't take the scroll op
+		if (own_dirty && (topics & TOPIC_CHANGE_CONTENT_PART) && !(topics & TOPIC_SCROLL)) {
+			screen_dirty_unscroll(&scr_dirty);
+		}
+
 		if (topics & TOPIC_CHANGE_CONTENT_PART) {
-			// reset dirty extents
+			// take over the dirty extents, they are sent as a series of row patches
 			ss->partial = true;
 
-			ss->x_min = scr_dirty.x_min;
-			ss->x_max = scr_dirty.x_max;
-			ss->y_min = scr_dirty.y_min;
-			ss->y_max = scr_dirty.y_max;
+			memcpy(ss->dirty_rows, dirty->rows, sizeof(dirty->rows));
+			memcpy(ss->dirty_x_min, dirty->x_min, sizeof(dirty->x_min));
+			memcpy(ss->dirty_x_max, dirty->x_max, sizeof(dirty->x_max));
 
-			if (ss->x_min > ss->x_max || ss->y_min > ss->y_max) {
-				seri_warn("Partial redraw, but bad bounds! X %d..%d, Y %d..%d", ss->x_min, ss->x_max, ss->y_min, ss->y_max);
+			if (!seri_next_patch(ss, 0)) {
+				seri_warn("Partial redraw, but no dirty rows!");
 				// use full redraw
-				reset_screen_dirty();
+				if (own_dirty) screen_dirty_reset();
 
 				topics ^= TOPIC_CHANGE_CONTENT_PART;
 				topics |= TOPIC_CHANGE_CONTENT_ALL;
-			} else {
-				// is OK
-				ss->i_max = ss->y_max * W + ss->x_max;
-				ss->index = W*ss->y_min + ss->x_min;
-				seri_dbg("Partial! X %d..%d, Y %d..%d, i_max %d", ss->x_min, ss->x_max, ss->y_min, ss->y_max, ss->i_max);
 			}
 		}
 
@@ -2329,15 +2930,31 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 			ss->x_max = W-1;
 			ss->y_min = 0;
 			ss->y_max = H-1;
+			ss->patch_begun = false;
 			seri_dbg("Full redraw!");
 		}
 
-		ss->i_start = ss->index;
+		// the scroll op is only valid together with the dirty rows it was recorded with
+		if ((topics & TOPIC_SCROLL) && (topics & TOPIC_CHANGE_CONTENT_PART) && !(topics & TOPIC_CHANGE_CONTENT_ALL)
+			&& dirty->scroll_lines != 0) {
+			ss->scroll_top = dirty->scroll_top;
+			ss->scroll_btm = dirty->scroll_btm;
+			ss->scroll_lines = dirty->scroll_lines;
+		} else {
+			topics &= ~TOPIC_SCROLL;
+			ss->scroll_lines = 0;
+		}
+
+		// the shadow is only meaningful for a client that had all changes up to the last reset
+		ss->shadow = !own_dirty && ss->partial && (topics & TOPIC_FLAG_SHADOW)
+					 && shadow.valid && shadow.width == W && shadow.height == H;
+		topics &= ~TOPIC_FLAG_SHADOW;
 
-		if ((topics & (TOPIC_CHANGE_CONTENT_ALL | TOPIC_CHANGE_CONTENT_PART)) && !(topics & TOPIC_FLAG_NOCLEAN)) {
-			reset_screen_dirty();
+		if (own_dirty && (topics & (TOPIC_CHANGE_CONTENT_ALL | TOPIC_CHANGE_CONTENT_PART)) && !(topics & TOPIC_FLAG_NOCLEAN)) {
+			screen_dirty_reset();
 		}
 
+		ss->binary = (topics & TOPIC_FLAG_BINARY) != 0;
 		ss->topics = topics;
 		ss->last_topic = 0; // to be filled
 		ss->current_topic = 0; // to be filled
@@ -2345,10 +2962,11 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 
 		bufput_c('U'); // - stands for "update"
 
-		bufput_utf8(topics);
-
-		if (ss->partial) {
-			// advance to the first char we want to send
+		if (ss->binary) {
+			// the flags are of no use to the client, leave them out to keep the varint short
+			bufput_num(topics & ~(TOPIC_FLAG_BINARY | TOPIC_FLAG_NOCLEAN));
+		} else {
+			bufput_num(topics);
 		}
 	}
 
@@ -2359,7 +2977,7 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 	if (ss->last_topic == prev_topic) { \
 		begun_topic = (topic); \
 		if (ss->topics & (topic)) { \
-            if (remain < (size)) return HTTPD_CGI_MORE;
+            if (remain < (size)) goto ser_more;
 
 #define END_TOPIC \
         } \
@@ -2372,13 +2990,13 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 		BEGIN_TOPIC(TOPIC_CHANGE_SCREEN_OPTS, 32+1)
 			bufput_c(TOPICMARK_SCREEN_OPTS);
 
-			bufput_utf8(H);
-			bufput_utf8(W);
-			bufput_utf8(termconf_live.theme);
-			bufput_color_utf8(termconf_live.default_fg);
-			bufput_color_utf8(termconf_live.default_bg);
+			bufput_num(H);
+			bufput_num(W);
+			bufput_num(termconf_live.theme);
+			bufput_color(termconf_live.default_fg);
+			bufput_color(termconf_live.default_bg);
 
-			bufput_utf8(
+			bufput_num(
 				(scr.cursor_visible << 0) |
 				(termconf_live.debugbar << 1) | // debugbar - this was previously "hanging"
 				(scr.cursors_alt_mode << 2) |
@@ -2398,15 +3016,9 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 		BEGIN_TOPIC(TOPIC_CHANGE_STATIC_OPTS, 110)
 			bufput_c(TOPICMARK_STATIC_OPTS);
 
-			size_t len = strlen(termconf_live.font_stack);
-			if (len > 0) {
-				memcpy(bb, termconf_live.font_stack, len);
-				bb += len;
-				remain -= len;
-			}
-			bufput_c('\x01');
+			bufput_str(termconf_live.font_stack);
 
-			bufput_utf8(termconf_live.font_size);
+			bufput_num(termconf_live.font_size);
 		END_TOPIC
 
 		BEGIN_TOPIC(TOPIC_DOUBLE_LINES, 70)
@@ -2416,11 +3028,11 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 			for (int i = 0; i < LINE_ATTRS_COUNT; i++) {
 				if (scr.line_attribs[i] != 0) cnt++;
 			}
-			bufput_utf8(cnt);
+			bufput_num(cnt);
 
 			for (int i = 0; i < LINE_ATTRS_COUNT; i++) {
 				if (scr.line_attribs[i] != 0) {
-					bufput_utf8((i << 3) | (scr.line_attribs[i]&0b111));
+					bufput_num((i << 3) | (scr.line_attribs[i]&0b111));
 				}
 			}
 		END_TOPIC
@@ -2428,32 +3040,20 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 		BEGIN_TOPIC(TOPIC_CHANGE_TITLE, TERM_TITLE_LEN+4+1)
 			bufput_c(TOPICMARK_TITLE);
 
-			size_t len = strlen(termconf_live.title);
-			if (len > 0) {
-				memcpy(bb, termconf_live.title, len);
-				bb += len;
-				remain -= len;
-			}
-			bufput_c('\x01');
+			bufput_str(termconf_live.title);
 		END_TOPIC
 
 		BEGIN_TOPIC(TOPIC_CHANGE_BUTTONS, (TERM_BTN_LEN+4)*termconf_live.button_count+1+4)
 			bufput_c(TOPICMARK_BUTTONS);
 
-			bufput_utf8(termconf_live.button_count);
+			bufput_num(termconf_live.button_count);
 
 			u32 *cp = &termconf_live.bc1;
 			for (int i = 0; i < termconf_live.button_count; i++) {
 				uint32_t c = *cp++;
-				bufput_color_utf8(c);
+				bufput_color(c);
 
-				size_t len = strlen(TERM_BTN_N(&termconf_live, i));
-				if (len > 0) {
-					memcpy(bb, TERM_BTN_N(&termconf_live, i), len);
-					bb += len;
-					remain -= len;
-				}
-				bufput_c('\x01');
+				bufput_str(TERM_BTN_N(&termconf_live, i));
 			}
 
 		END_TOPIC
@@ -2461,19 +3061,13 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 		BEGIN_TOPIC(TOPIC_CHANGE_BACKDROP, TERM_BACKDROP_LEN+1+1)
 			bufput_c(TOPICMARK_BACKDROP);
 
-			size_t len = strlen(termconf_live.backdrop);
-			if (len > 0) {
-				memcpy(bb, termconf_live.backdrop, len);
-				bb += len;
-				remain -= len;
-			}
-			bufput_c('\x01');
+			bufput_str(termconf_live.backdrop);
 		END_TOPIC
 
 		BEGIN_TOPIC(TOPIC_INTERNAL, 45)
 			bufput_c(TOPICMARK_DEBUG);
 			// General flags
-			bufput_utf8(
+			bufput_num(
 				(scr.insert_mode << 0) |
 				(cursor.conceal << 1) |
 				(cursor.auto_wrap << 2) |
@@ -2482,16 +3076,16 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 				(cursor_saved << 5) |
 				(state_backup.alternate_active << 6)
 			);
-			bufput_utf8(cursor.attrs);
-			bufput_utf8(scr.vm0);
-			bufput_utf8(scr.vm1);
-			bufput_utf8(cursor.charsetN);
+			bufput_num(cursor.attrs);
+			bufput_num(scr.vm0);
+			bufput_num(scr.vm1);
+			bufput_num(cursor.charsetN);
 			bufput_c(cursor.charset0);
 			bufput_c(cursor.charset1);
-			bufput_color_utf8(cursor.fg);
-			bufput_color_utf8(cursor.bg);
-			bufput_utf8(system_get_free_heap_size());
-			bufput_utf8(term_active_clients);
+			bufput_color(cursor.fg);
+			bufput_color(cursor.bg);
+			bufput_num(system_get_free_heap_size());
+			bufput_num(term_active_clients);
 		END_TOPIC
 
 		BEGIN_TOPIC(TOPIC_BELL, 1)
@@ -2500,14 +3094,27 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 
 		BEGIN_TOPIC(TOPIC_CHANGE_CURSOR, 13)
 			bufput_c(TOPICMARK_CURSOR);
-			bufput_utf8(cursor.y);
-			bufput_utf8(cursor.x);
-			bufput_utf8(
+			bufput_num(cursor.y);
+			bufput_num(cursor.x);
+			bufput_num(
 				(cursor.hanging << 0)
 			);
 		END_TOPIC
 
-		if (ss->last_topic == TOPIC_CHANGE_CURSOR) {
+		BEGIN_TOPIC(TOPIC_SCROLL, 13)
+			bufput_c(TOPICMARK_SCROLL);
+			bufput_num(ss->scroll_top);
+			bufput_num(ss->scroll_btm);
+			if (ss->scroll_lines > 0) {
+				bufput_num(ss->scroll_lines);
+				bufput_num(0); // up
+			} else {
+				bufput_num(-ss->scroll_lines);
+				bufput_num(1); // down
+			}
+		END_TOPIC
+
+		if (ss->last_topic == TOPIC_SCROLL) {
 			// now we can begin any of the two screen sequences
 
 			if (ss->topics & TOPIC_CHANGE_CONTENT_ALL) {
@@ -2536,117 +3143,154 @@ screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics,
 
 	// screen contents
 	int i = ss->index;
-	if (i == ss->i_start) {
-		bufput_c(TOPICMARK_SCREEN); // desired update mode is in `ss->current_topic`
-		bufput_utf8(ss->y_min); // Y0
-		bufput_utf8(ss->x_min); // X0
-		bufput_utf8(ss->y_max - ss->y_min + 1); // height
-		bufput_utf8(ss->x_max - ss->x_min + 1); // width
-		ss->index = 0;
-		ss->lastBg = 0;
-		ss->lastFg = 0;
-		ss->lastLiveBg = 0;
-		ss->lastLiveFg = 0;
-		ss->lastAttrs = 0;
-		ss->lastCharLen = 0;
-		ss->lastSymbol = 0;
-		ss->first = 1;
-	}
-	while(i <= ss->i_max && remain > 12) {
-		cell = cell0 = &screen[i];
-
-		int repCnt = 0;
-
-		if (!ss->first) {
-			// Count how many times same as previous
-			while (i <= ss->i_max
-				   && cell->fg == ss->lastFg
-				   && cell->bg == ss->lastBg
-				   && cell->attrs == ss->lastAttrs
-				   && cell->symbol == ss->lastSymbol) {
-				// Repeat
-				repCnt++;
-				INC_I();
-				cell = &screen[i]; // it can go outside the allocated memory here if we went over the top
-			}
+	while (1) {
+		if (!ss->patch_begun) {
+			if (remain < 12+12) goto ser_more;
+			bufput_c(TOPICMARK_SCREEN); // desired update mode is in `ss->current_topic`
+			bufput_num(ss->y_min); // Y0
+			bufput_num(ss->x_min); // X0
+			bufput_num(ss->y_max - ss->y_min + 1); // height
+			bufput_num(ss->x_max - ss->x_min + 1); // width
+			ss->lastBg = 0;
+			ss->lastFg = 0;
+			ss->lastLiveBg = 0;
+			ss->lastLiveFg = 0;
+			ss->lastAttrs = 0;
+			ss->lastCharLen = 0;
+			ss->lastSymbol = 0;
+			ss->first = 1;
+			ss->patch_begun = true;
 		}
 
-		if (repCnt == 0) {
-			// No repeat - first occurrence
-			bool changeAttrs = ss->first || (cell0->attrs != ss->lastAttrs);
-			bool changeFg = (cell0->fg != ss->lastLiveFg) && (cell0->attrs & ATTR_FG);
-			bool changeBg = (cell0->bg != ss->lastLiveBg) && (cell0->attrs & ATTR_BG);
-			bool changeColors = ss->first || (changeFg && changeBg);
-			Color fg, bg;
-			ss->first = false;
-
-			// Reverse fg and bg if we're in global reverse mode
-			fg = cell0->fg;
-			bg = cell0->bg;
-
-			if (changeColors) {
-				bufput_t_utf8(SEQ_TAG_COLORS, bg<<8 | fg);
-			}
-			else if (changeFg) {
-				bufput_t_utf8(SEQ_TAG_FG, fg);
-			}
-			else if (changeBg) {
-				bufput_t_utf8(SEQ_TAG_BG, bg);
-			}
+		while(i <= ss->i_max && remain > 12) {
+			cell = CELL(i / W, i % W);
+			if (ss->shadow && (ss->first || cell->fg != ss->lastFg || cell->bg != ss->lastBg
+							   || cell->attrs != ss->lastAttrs || cell->symbol != ss->lastSymbol)) {
+				// Count how many cells the client already has (unless they'd just extend a repeat)
+				int skipCnt = 0;
+				int i0 = i;
+				bool uniform = true; // all the same as the first one, so a repeat would cover them
+				const Cell *prev;
+				while (i <= ss->i_max
+					   && (prev = seri_shadow_cell(ss, i / W, i % W)) != NULL
+					   && memcmp(prev, CELL(i / W, i % W), sizeof(Cell)) == 0) {
+					if (uniform && memcmp(cell, prev, sizeof(Cell)) != 0) uniform = false;
+					skipCnt++;
+					INC_I();
+				}
 
-			if (changeAttrs) {
-				if (cell0->attrs) {
-					bufput_t_utf8(SEQ_TAG_ATTRS, cell0->attrs);
-				} else {
-					bufput_c(SEQ_TAG_ATTRS_0);
+				// a uniform run that continues past the skip is cheaper to send as one repeat
+				if (uniform && i <= ss->i_max && memcmp(cell, CELL(i / W, i % W), sizeof(Cell)) == 0) {
+					skipCnt = 0;
+				}
+
+				if (skipCnt >= SERI_SKIP_MIN) {
+					bufput_t_num(SEQ_TAG_SKIP, skipCnt);
+					continue;
 				}
+				i = i0;
 			}
 
-			// copy the symbol, until first 0 or reached 4 bytes
-			char c;
-			ss->lastCharLen = 0;
-			unicode_cache_retrieve(cell->symbol, (u8 *) ss->lastChar);
-			for(int j=0; j<4; j++) {
-				c = ss->lastChar[j];
-				if(!c) break;
-				bufput_c(c);
-				ss->lastCharLen++;
+			cell = cell0 = CELL(i / W, i % W);
+
+			int repCnt = 0;
+
+			if (!ss->first) {
+				// Count how many times same as previous
+				while (cell->fg == ss->lastFg
+					   && cell->bg == ss->lastBg
+					   && cell->attrs == ss->lastAttrs
+					   && cell->symbol == ss->lastSymbol) {
+					// Repeat
+					repCnt++;
+					INC_I();
+					if (i > ss->i_max) break;
+					cell = CELL(i / W, i % W);
+				}
 			}
 
-			ss->lastFg = cell0->fg;
-			ss->lastBg = cell0->bg;
-			if (cell0->attrs & ATTR_FG) ss->lastLiveFg = cell0->fg;
-			if (cell0->attrs & ATTR_BG) ss->lastLiveBg = cell0->bg;
-			ss->lastAttrs = cell0->attrs;
-			ss->lastSymbol = cell0->symbol;
+			if (repCnt == 0) {
+				// No repeat - first occurrence
+				bool changeAttrs = ss->first || (cell0->attrs != ss->lastAttrs);
+				bool changeFg = (cell0->fg != ss->lastLiveFg) && (cell0->attrs & ATTR_FG);
+				bool changeBg = (cell0->bg != ss->lastLiveBg) && (cell0->attrs & ATTR_BG);
+				bool changeColors = ss->first || (changeFg && changeBg);
+				Color fg, bg;
+				ss->first = false;
+
+				// Reverse fg and bg if we're in global reverse mode
+				fg = cell0->fg;
+				bg = cell0->bg;
+
+				if (changeColors) {
+					bufput_t_num(SEQ_TAG_COLORS, bg<<8 | fg);
+				}
+				else if (changeFg) {
+					bufput_t_num(SEQ_TAG_FG, fg);
+				}
+				else if (changeBg) {
+					bufput_t_num(SEQ_TAG_BG, bg);
+				}
 
-			INC_I();
-		} else {
-			// last character was repeated repCnt times
-			int savings = ss->lastCharLen*repCnt;
-			if (savings > 2) {
-				// Repeat count
-				bufput_t_utf8(SEQ_TAG_REPEAT, repCnt);
+				if (changeAttrs) {
+					if (cell0->attrs) {
+						bufput_t_num(SEQ_TAG_ATTRS, cell0->attrs);
+					} else {
+						bufput_c(SEQ_TAG_ATTRS_0);
+					}
+				}
+
+				// copy the symbol, until first 0 or reached 4 bytes
+				char c;
+				ss->lastCharLen = 0;
+				unicode_cache_retrieve(cell->symbol, (u8 *) ss->lastChar);
+				for(int j=0; j<4; j++) {
+					c = ss->lastChar[j];
+					if(!c) break;
+					bufput_c(c);
+					ss->lastCharLen++;
+				}
+
+				ss->lastFg = cell0->fg;
+				ss->lastBg = cell0->bg;
+				if (cell0->attrs & ATTR_FG) ss->lastLiveFg = cell0->fg;
+				if (cell0->attrs & ATTR_BG) ss->lastLiveBg = cell0->bg;
+				ss->lastAttrs = cell0->attrs;
+				ss->lastSymbol = cell0->symbol;
+
+				INC_I();
 			} else {
-				// repeat it manually
-				for(int k = 0; k < repCnt; k++) {
-					for (int j = 0; j < ss->lastCharLen; j++) {
-						bufput_c(ss->lastChar[j]);
+				// last character was repeated repCnt times
+				int savings = ss->lastCharLen*repCnt;
+				if (savings > 2) {
+					// Repeat count
+					bufput_t_num(SEQ_TAG_REPEAT, repCnt);
+				} else {
+					// repeat it manually
+					for(int k = 0; k < repCnt; k++) {
+						for (int j = 0; j < ss->lastCharLen; j++) {
+							bufput_c(ss->lastChar[j]);
+						}
 					}
 				}
 			}
 		}
-	}
 
-	ss->index = i;
-	if (i >= ss->i_max) goto ser_done;
+		ss->index = i;
+		if (i <= ss->i_max) goto ser_more; // out of space
+
+		// this patch is complete, continue with the next one (if any)
+		if (!ss->partial || !seri_next_patch(ss, ss->y_max + 1)) goto ser_done;
+		i = ss->index;
+	}
 
+ser_more:
 	// MORE TO WRITE...
-	bufput_c('\0'); // terminate the string
+	*out_len = bb - buffer;
 	return HTTPD_CGI_MORE;
 
 ser_done:
-	bufput_c('\0'); // terminate the string
+	*out_len = bb - buffer;
 	return HTTPD_CGI_DONE;
 }
 //endregion
@@ -44,6 +44,7 @@
 
 #define SCR_DEF_DISPLAY_TOUT_MS 12
 #define SCR_DEF_DISPLAY_COOLDOWN_MS 35
+#define SCR_DEF_DISPLAY_MAX_LATENCY_MS 100 // longest time a change can wait for the debounce
 #define SCR_DEF_PARSER_TOUT_MS 0
 #define SCR_DEF_FN_ALT_MODE true // true - SS3 codes, easier to parse & for xterm compatibility
 #define SCR_DEF_WIDTH 26
@@ -52,6 +53,8 @@
 
 /** Maximum screen size (determines size of the static data array) */
 #define MAX_SCREEN_SIZE (80*25)
+/** Maximum number of rows (determines size of the per-row tables) */
+#define MAX_SCREEN_ROWS 64
 
 enum CursorShape {
 	CURSOR_BLOCK_BL = 0,
@@ -79,7 +82,7 @@ enum CursorShape {
 // Size designed for the terminal config structure
 // Must be constant to avoid corrupting user config after upgrade
 #define TERMCONF_SIZE 500
-#define TERMCONF_VERSION 6
+#define TERMCONF_VERSION 7
 
 //....Type................Name..Suffix...............Deref..XGET.........Cast..XSET...........NOTIFY..Allow
 // Deref is used to pass the field to xget. Cast is used to convert the &'d field to what xset wants (needed for static arrays)
@@ -122,7 +125,8 @@ enum CursorShape {
 	X(u32,            bc4, /**/,      /**/, xget_term_color,  xset_term_color, NULL,  /**/, 1) \
 	X(u32,            bc5, /**/,      /**/, xget_term_color,  xset_term_color, NULL,  /**/, 1) \
 	X(char,           font_stack, [TERM_FONTSTACK_LEN], /**/, xget_string,  xset_string, TERM_FONTSTACK_LEN,  /**/, 1) \
-	X(u8,             font_size, /**/,              /**/, xget_dec,      xset_u8, NULL,       /**/, 1)
+	X(u8,             font_size, /**/,              /**/, xget_dec,      xset_u8, NULL,       /**/, 1) \
+	X(u32,            display_max_latency_ms, /**/, /**/, xget_dec,      xset_u32, NULL,      /**/, 1)
 
 /** Get button N message from the passed config structure pointer */
 #define TERM_BM_N(tc, n) ((tc)->bm1+(TERM_BTN_MSG_LEN*(n)))
@@ -221,6 +225,9 @@ enum ScreenSerializeTopic {
 	TOPIC_CHANGE_BACKDROP     = (1<<8),
 	TOPIC_CHANGE_STATIC_OPTS  = (1<<9),
 	TOPIC_DOUBLE_LINES        = (1<<10),
+	TOPIC_SCROLL              = (1<<11), // scroll region shift, sent ahead of the content (opt-in, see screen_dirty_unscroll())
+	TOPIC_FLAG_SHADOW         = (1<<13), // the client has all changes up to the last screen_dirty_reset(), unchanged cells can be skipped
+	TOPIC_FLAG_BINARY         = (1<<14), // use the binary message format (varint numbers, length-prefixed strings)
 	TOPIC_FLAG_NOCLEAN        = (1<<15), // do not clean dirty extents
 
 	// combos
@@ -237,7 +244,36 @@ enum ScreenSerializeTopic {
 
 typedef u16 ScreenNotifyTopics;
 
-httpd_cgi_state screenSerializeToBuffer(char *buffer, size_t buf_len, ScreenNotifyTopics topics, void **data);
+#define DIRTY_ROW_WORDS ((MAX_SCREEN_ROWS+31)/32)
+
+/**
+ * Dirty extents - a bitmap of changed rows, each with its own column span,
+ * and a region scroll to be applied before them.
+ * The spans are valid only for rows that have their bit set.
+ */
+typedef struct {
+	u32 rows[DIRTY_ROW_WORDS];
+	u16 x_min[MAX_SCREEN_ROWS];
+	u16 x_max[MAX_SCREEN_ROWS];
+	int scroll_top;
+	int scroll_btm;
+	int scroll_lines; // positive - up, negative - down, 0 - no scroll pending
+} ScreenDirty;
+
+#define ROW_IS_DIRTY(bitmap, y) (((bitmap)[(y)/32] >> ((y)%32)) & 1)
+
+/** Merge the changes recorded since the last screen_dirty_reset() into a client's copy */
+void screen_dirty_merge(ScreenDirty *into);
+/** Replace a pending scroll with a redraw of the region, for a client that doesn't take TOPIC_SCROLL */
+void screen_dirty_unscroll(ScreenDirty *d);
+/** Forget the changes recorded by the screen, updating the shadow copy used for TOPIC_FLAG_SHADOW */
+void screen_dirty_reset(void);
+/** Free the shadow copy */
+void screen_shadow_discard(void);
+/** Compare two sets of changes */
+bool screen_dirty_equal(const ScreenDirty *a, const ScreenDirty *b);
+
+httpd_cgi_state screenSerializeToBuffer(char *buffer, size_t buf_len, size_t *out_len, ScreenNotifyTopics topics, const ScreenDirty *dirty, void **data);
 
 // --- Clearing ---
 
@@ -255,7 +291,7 @@ void screen_clear(ClearMode mode);
 void screen_clear_line(ClearMode mode);
 /** Clear part of line */
 void screen_clear_in_line(unsigned int count);
-/** Swap to alternate buffer (really what this does is backup terminal title, size and other global attributes) */
+/** Swap to alternate buffer (backs up terminal title, size and other global attributes, and the screen content if there is enough RAM) */
 void screen_swap_state(bool alternate);
 
 // --- insert / delete ---
@@ -361,6 +397,8 @@ void screen_save_private_opt(int n);
 void screen_restore_private_opt(int n);
 /** Set bracketed paste */
 void screen_set_bracketed_paste(bool ena);
+/** Synchronized update - hold back screen updates until it's disabled */
+void screen_set_synchronized_update(bool ena);
 
 // --- Charset ---
 
@@ -395,6 +433,12 @@ void screen_set_line_attr(uint8_t double_w, uint8_t double_h_top, uint8_t double
  * unicode (then it can be 4 chars, or terminated by a zero)
  */
 void screen_putchar(const char *ch);
+
+/**
+ * Write a run of printable ASCII characters (32-126) in the cursor color, with wrap.
+ * This is a faster equivalent of calling screen_putchar() for each of them.
+ */
+void screen_putchars(const char *buf, size_t len);
 /**
  * esc # 8 - fill entire screen with E of default colors
  * (DEC alignment test mode)
@@ -419,6 +463,13 @@ void screen_report_sgr(char *buffer);
  */
 extern void screen_notifyChange(ScreenNotifyTopics topics);
 
+/**
+ * Called when a synchronized update begins or ends.
+ * Change notifications are collected, but not sent while it's active.
+ * @param hold - true when the update begins
+ */
+extern void screen_notifyHold(bool hold);
+
 #define seri_dbg(...)
 #define seri_warn(...) warn(__VA_ARGS__)
 
@@ -1,6 +1,7 @@
 #include <esp8266.h>
 #include "uart_driver.h"
 #include "uart_handler.h"
+#include "uart_buffer.h"
 #include "ansi_parser.h"
 #include "syscfg.h"
 
@@ -82,6 +83,7 @@ void ICACHE_FLASH_ATTR serialInit(void)
 	UART_SetParity(UART0, (UartParityMode) sysconf->uart_parity);
 	UART_SetStopBits(UART0, (UartStopBitsNum) sysconf->uart_stopbits);
 	UART_SetBaudrate(UART0, sysconf->uart_baudrate);
+	UART_SetupFlowControl((UartFlowCtrl) sysconf->uart_flowctrl);
 
 	// GPIO2 may be used as a remotely controlled GPIO
 	if (sysconf->gpio2_conf == GPIOCONF_OFF) {
@@ -91,21 +93,25 @@ void ICACHE_FLASH_ATTR serialInit(void)
 		// further config of the GPIO will be done in persist.c after calling this func
 	}
 
-	info("COM SERIAL: %d baud, %s parity, %s stopbit(s)",
+	info("COM SERIAL: %d baud, %s parity, %s stopbit(s), %s flow control",
 		 sysconf->uart_baudrate,
 		 (sysconf->uart_parity == PARITY_NONE ? "NONE" : (sysconf->uart_parity == PARITY_ODD ? "ODD" : "EVEN")),
-		 (sysconf->uart_stopbits == ONE_STOP_BIT ? "1" : (sysconf->uart_stopbits == ONE_HALF_STOP_BIT ? "1.5" : "2"))
+		 (sysconf->uart_stopbits == ONE_STOP_BIT ? "1" : (sysconf->uart_stopbits == ONE_HALF_STOP_BIT ? "1.5" : "2")),
+		 (sysconf->uart_flowctrl == NONE_CTRL ? "no" : (sysconf->uart_flowctrl == HARDWARE_CTRL ? "RTS" : "XON/XOFF"))
 	);
 }
 
 /**
- * Handle a byte received from UART.
- * Might do some buffering here maybe
+ * Handle a chunk of bytes received from UART.
  *
- * @param c
+ * @param buf - received bytes
+ * @param len - number of bytes
  */
-void ICACHE_FLASH_ATTR UART_HandleRxByte(char c)
+void ICACHE_FLASH_ATTR UART_HandleRxData(const char *buf, size_t len)
 {
-	ansi_parser(c);
+	ansi_parser_feed(buf, len);
+	// printable chars are written in runs, flush when there's nothing more to read
+	// (the chunk being handled stays in the rx buffer until it's committed)
+	if (UART_AsyncRxCount() <= len) ansi_parser_flush();
 	system_soft_wdt_feed(); // so we survive long torrents
 }
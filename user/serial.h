@@ -7,6 +7,6 @@ void serialInitBase(void);
 /** Init the uarts */
 void serialInit(void);
 
-void UART_HandleRxByte(char c);
+void UART_HandleRxData(const char *buf, size_t len);
 
 #endif //SERIAL_H
@@ -77,6 +77,23 @@ xset_sys_stopbits(const char *name, u8 *field, const char *buff, const void *arg
 	}
 }
 
+enum xset_result ICACHE_FLASH_ATTR
+xset_sys_flowctrl(const char *name, u8 *field, const char *buff, const void *arg)
+{
+	cgi_dbg("Setting %s = %s", name, buff);
+	int flowctrl = atoi(buff);
+	if (flowctrl == NONE_CTRL || flowctrl == HARDWARE_CTRL || flowctrl == XON_XOFF_CTRL) {
+		if (*field != flowctrl) {
+			*field = (UartFlowCtrl) flowctrl;
+			return XSET_SET;
+		}
+		return XSET_UNCHANGED;
+	} else {
+		cgi_warn("Bad flow control %s", buff);
+		return XSET_FAIL;
+	}
+}
+
 enum xset_result ICACHE_FLASH_ATTR
 xset_sys_pwlock(const char *name, u8 *field, const char *buff, const void *arg)
 {
@@ -128,6 +145,12 @@ sysconf_apply_settings(void)
 		changed = true;
 	}
 
+	if (sysconf->config_version < 3) {
+		dbg("Upgrading syscfg to v 3");
+		sysconf->uart_flowctrl = NONE_CTRL;
+		changed = true;
+	}
+
 	sysconf->config_version = SYSCONF_VERSION;
 
 	if (changed) {
@@ -149,6 +172,7 @@ sysconf_restore_defaults(void)
 	sysconf->uart_parity = PARITY_NONE;
 	sysconf->uart_baudrate = BIT_RATE_115200;
 	sysconf->uart_stopbits = ONE_STOP_BIT;
+	sysconf->uart_flowctrl = NONE_CTRL;
 	sysconf->config_version = SYSCONF_VERSION;
 	sysconf->access_pw[0] = 0;
 	sysconf->pwlock = PWLOCK_NONE;
@@ -11,7 +11,7 @@
 // Size designed for the wifi config structure
 // Must be constant to avoid corrupting user config after upgrade
 #define SYSCONF_SIZE 300
-#define SYSCONF_VERSION 2
+#define SYSCONF_VERSION 3
 
 #define DEF_ACCESS_PW "1234"
 #define DEF_ACCESS_NAME "espterm"
@@ -49,7 +49,9 @@ enum gpioconf {
 	X(bool,            overclock, /**/,               /**/, xget_bool,     xset_bool, NULL,           /**/, 1) \
 	X(u8,              gpio2_conf, /**/,              /**/, xget_dec,      xset_u8, NULL,             /**/, 1) \
 	X(u8,              gpio4_conf, /**/,              /**/, xget_dec,      xset_u8, NULL,             /**/, 1) \
-	X(u8,              gpio5_conf, /**/,              /**/, xget_dec,      xset_u8, NULL,             /**/, 1)
+	X(u8,              gpio5_conf, /**/,              /**/, xget_dec,      xset_u8, NULL,             /**/, 1) \
+	\
+	X(u8,              uart_flowctrl, /**/,           /**/, xget_dec,      xset_sys_flowctrl, NULL,   uart_changed=true, 1)
 
 typedef struct {
 #define X XSTRUCT_FIELD
@@ -76,6 +78,7 @@ void sysconf_restore_defaults(void);
 enum xset_result xset_sys_baudrate(const char *name, u32 *field, const char *buff, const void *arg);
 enum xset_result xset_sys_parity(const char *name, u8 *field, const char *buff, const void *arg);
 enum xset_result xset_sys_stopbits(const char *name, u8 *field, const char *buff, const void *arg);
+enum xset_result xset_sys_flowctrl(const char *name, u8 *field, const char *buff, const void *arg);
 enum xset_result xset_sys_pwlock(const char *name, u8 *field, const char *buff, const void *arg);
 enum xset_result xset_sys_accesspw(const char *name, uchar *field, const char *buff, const void *arg);
 
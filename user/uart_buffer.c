@@ -7,67 +7,70 @@
 #include "uart_handler.h"
 #include <esp8266.h>
 #include <uart_register.h>
+#include "ascii.h"
 
 //#define buf_dbg(format, ...) printf(format "\r\n", ##__VA_ARGS__)
 #define buf_dbg(format, ...) (void)format
 
+#if (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) || (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1))
+#error "UART buffer sizes must be powers of two"
+#endif
+
+/**
+ * Single-producer single-consumer ring buffer.
+ *
+ * The indices are free-running and only masked when accessing the array, so
+ * head - tail is always the number of stored bytes. The producer only ever
+ * writes head and the consumer only writes tail, so the two sides need no
+ * locking and no shared counter. (Rx: filled by the recv task, drained by
+ * the process task. Tx: filled by tasks, drained by the FIFO empty interrupt.)
+ */
 struct UartBuffer {
-	uint32 UartBuffSize;
-	uint8 *pUartBuff;
-	uint8 *pInPos;
-	uint8 *pOutPos;
-	uint16 Space;
+	uint8 *data;
+	uint16 mask; //!< size - 1
+	volatile uint16 head; //!< write index, moved by the producer
+	volatile uint16 tail; //!< read index, moved by the consumer
 };
 
-static struct UartBuffer *pTxBuffer = NULL;
-static struct UartBuffer *pRxBuffer = NULL;
+/** Keep the compiler from moving buffer accesses across an index update */
+#define RING_BARRIER() __asm__ __volatile__("" ::: "memory")
 
 static u8 rxArray[UART_RX_BUFFER_SIZE];
 static u8 txArray[UART_TX_BUFFER_SIZE];
 
-static struct UartBuffer *UART_AsyncBufferInit(uint32 buf_size, u8 *buffer);
+static struct UartBuffer rxBuffer = {rxArray, UART_RX_BUFFER_SIZE - 1, 0, 0};
+static struct UartBuffer txBuffer = {txArray, UART_TX_BUFFER_SIZE - 1, 0, 0};
 
-void ICACHE_FLASH_ATTR UART_AllocBuffers(void)
+// Rx flow control watermarks - the peer is paused above the high mark and resumed
+// once the buffer drains below the low mark
+#define RX_HIGH_WATER (UART_RX_BUFFER_SIZE - UART_RX_BUFFER_SIZE / 4)
+#define RX_LOW_WATER (UART_RX_BUFFER_SIZE / 4)
+
+UartStats uart_stats;
+
+/** Rx flow control mode */
+static UartFlowCtrl rx_flow = NONE_CTRL;
+/** The peer was asked to pause */
+static bool rx_throttled = false;
+
+static inline uint16 ring_count(const struct UartBuffer *pBuff)
 {
-	pTxBuffer = UART_AsyncBufferInit(UART_TX_BUFFER_SIZE, txArray);
-	pRxBuffer = UART_AsyncBufferInit(UART_RX_BUFFER_SIZE, rxArray);
+	return (uint16) (pBuff->head - pBuff->tail);
 }
 
-/******************************************************************************
- * FunctionName : Uart_Buf_Init
- * Description  : tx buffer enqueue: fill a first linked buffer
- * Parameters   : char *pdata - data point  to be enqueue
- * Returns      : NONE
-*******************************************************************************/
-static struct UartBuffer *ICACHE_FLASH_ATTR
-UART_AsyncBufferInit(uint32 buf_size, u8 *buffer)
+static inline uint16 ring_space(const struct UartBuffer *pBuff)
 {
-	uint32 heap_size = system_get_free_heap_size();
-	if (heap_size <= buf_size) {
-		error("uart buf malloc fail, out of memory");
-		return NULL;
-	}
-	else {
-		struct UartBuffer *pBuff = (struct UartBuffer *) malloc(sizeof(struct UartBuffer));
-		pBuff->UartBuffSize = buf_size;
-		pBuff->pUartBuff = buffer != NULL ? buffer : (uint8 *) malloc(pBuff->UartBuffSize);
-		pBuff->pInPos = pBuff->pUartBuff;
-		pBuff->pOutPos = pBuff->pUartBuff;
-		pBuff->Space = (uint16) pBuff->UartBuffSize;
-		return pBuff;
-	}
+	return (uint16) (pBuff->mask + 1 - ring_count(pBuff));
 }
 
-static void ICACHE_FLASH_ATTR
-UART_AsyncBufferReset(struct UartBuffer *pBuff)
+void ICACHE_FLASH_ATTR UART_AllocBuffers(void)
 {
-	pBuff->pInPos = pBuff->pUartBuff;
-	pBuff->pOutPos = pBuff->pUartBuff;
-	pBuff->Space = (uint16) pBuff->UartBuffSize;
+	rxBuffer.head = rxBuffer.tail = 0;
+	txBuffer.head = txBuffer.tail = 0;
 }
 
 /**
- * Copy data onto Buffer
+ * Copy data onto Buffer. The caller must check there is enough space.
  * @param pCur - buffer
  * @param pdata - data src
  * @param data_len - data len
@@ -77,47 +80,105 @@ UART_WriteToAsyncBuffer(struct UartBuffer *pCur, const char *pdata, uint16 data_
 {
 	if (data_len == 0) return;
 
-	buf_dbg("WTAB %d, space %d", data_len, pCur->Space);
+	const uint16 pos = (uint16) (pCur->head & pCur->mask);
+	uint16 tail_len = (uint16) (pCur->mask + 1 - pos);
+	if (tail_len > data_len) tail_len = data_len;
 
-	uint16 tail_len = (uint16) (pCur->pUartBuff + pCur->UartBuffSize - pCur->pInPos);
-	if (tail_len >= data_len) {  //do not need to loop back  the queue
-		buf_dbg("tail %d, no fold", tail_len);
-		memcpy(pCur->pInPos, pdata, data_len);
-		pCur->pInPos += (data_len);
-		pCur->pInPos = (pCur->pUartBuff + (pCur->pInPos - pCur->pUartBuff) % pCur->UartBuffSize);
-		pCur->Space -= data_len;
+	buf_dbg("WTAB %d at %d, fold %d", data_len, pos, data_len - tail_len);
+	memcpy(pCur->data + pos, pdata, tail_len);
+	memcpy(pCur->data, pdata + tail_len, (size_t) (data_len - tail_len));
+
+	RING_BARRIER();
+	pCur->head += data_len;
+}
+
+u16 ICACHE_FLASH_ATTR UART_AsyncRxCount(void)
+{
+	return ring_count(&rxBuffer);
+}
+
+/**
+ * Pause or resume the peer. With XON/XOFF the control char skips the Tx buffer,
+ * with hardware flow control the UART deasserts RTS by itself once the Rx data
+ * is left to accumulate in the FIFO.
+ *
+ * @param pause - true to pause
+ */
+static void ICACHE_FLASH_ATTR
+UART_RxThrottle(bool pause)
+{
+	rx_throttled = pause;
+	if (pause) uart_stats.rx_paused++;
+	if (rx_flow == XON_XOFF_CTRL) {
+		UART_WriteChar(UART0, (uint8) (pause ? XOFF : XON), 100);
 	}
-	else {
-		buf_dbg("tail only %d, folding", tail_len);
-		memcpy(pCur->pInPos, pdata, tail_len);
-		buf_dbg("chunk 1, %d", tail_len);
-		pCur->pInPos += (tail_len);
-		pCur->pInPos = (pCur->pUartBuff + (pCur->pInPos - pCur->pUartBuff) % pCur->UartBuffSize);
-		pCur->Space -= tail_len;
-		buf_dbg("chunk 2, %d", data_len - tail_len);
-		memcpy(pCur->pInPos, pdata + tail_len, data_len - tail_len);
-		pCur->pInPos += (data_len - tail_len);
-		pCur->pInPos = (pCur->pUartBuff + (pCur->pInPos - pCur->pUartBuff) % pCur->UartBuffSize);
-		pCur->Space -= (data_len - tail_len);
+	buf_dbg("Rx %s", pause ? "paused" : "resumed");
+}
+
+/**
+ * Set the Rx flow control mode (the UART registers are configured by the caller)
+ *
+ * @param mode - flow control mode
+ */
+void ICACHE_FLASH_ATTR
+UART_SetRxFlowMode(UartFlowCtrl mode)
+{
+	if (rx_throttled) {
+		// don't leave the peer paused
+		UART_RxThrottle(false);
 	}
-	buf_dbg("new space %d", pCur->Space);
+	rx_flow = mode;
 }
 
-/******************************************************************************
- * FunctionName : uart_buf_free
- * Description  : deinit of the tx buffer
- * Parameters   : struct UartBuffer* pTxBuff - tx buffer struct pointer
- * Returns      : NONE
-*******************************************************************************/
-void ICACHE_FLASH_ATTR UART_FreeAsyncBuffer(struct UartBuffer *pBuff)
+/**
+ * Check if the Rx data is being held in the UART FIFO, to make the hardware
+ * deassert RTS. The Rx interrupt must stay disabled in the meantime.
+ *
+ * @return true if the FIFO should not be collected
+ */
+bool ICACHE_FLASH_ATTR
+UART_RxFifoHeld(void)
 {
-	free(pBuff->pUartBuff);
-	free(pBuff);
+	return rx_throttled && rx_flow == HARDWARE_CTRL;
 }
 
-u16 ICACHE_FLASH_ATTR UART_AsyncRxCount(void)
+/**
+ * Get the received data that can be read in one piece (up to the end of the
+ * ring array) without removing it from the buffer. Follow with UART_RxCommit().
+ *
+ * @param pdata - is set to point to the data
+ * @return number of bytes available at *pdata
+ */
+uint16 ICACHE_FLASH_ATTR
+UART_RxPeek(const char **pdata)
 {
-	return (u16) (pRxBuffer->UartBuffSize - pRxBuffer->Space);
+	const uint16 count = ring_count(&rxBuffer);
+	const uint16 pos = (uint16) (rxBuffer.tail & rxBuffer.mask);
+	const uint16 tail_len = (uint16) (rxBuffer.mask + 1 - pos);
+
+	RING_BARRIER();
+	*pdata = (const char *) (rxBuffer.data + pos);
+	return (count < tail_len) ? count : tail_len;
+}
+
+/**
+ * Release bytes obtained from UART_RxPeek()
+ *
+ * @param data_len - number of bytes consumed
+ */
+void ICACHE_FLASH_ATTR
+UART_RxCommit(uint16 data_len)
+{
+	RING_BARRIER();
+	rxBuffer.tail += data_len;
+
+	if (rx_throttled && ring_count(&rxBuffer) <= RX_LOW_WATER) {
+		UART_RxThrottle(false);
+	}
+
+	if (!UART_RxFifoHeld() && ring_space(&rxBuffer) >= UART_FIFO_LEN) {
+		uart_rx_intr_enable(UART0);
+	}
 }
 
 /**
@@ -129,43 +190,19 @@ u16 ICACHE_FLASH_ATTR UART_AsyncRxCount(void)
 uint16 ICACHE_FLASH_ATTR
 UART_ReadAsync(char *pdata, uint16 data_len)
 {
-	uint16 buf_len = (uint16) (pRxBuffer->UartBuffSize - pRxBuffer->Space);
-	uint16 tail_len = (uint16) (pRxBuffer->pUartBuff + pRxBuffer->UartBuffSize - pRxBuffer->pOutPos);
-	uint16 len_tmp = 0;
-	len_tmp = ((data_len > buf_len) ? buf_len : data_len);
-	if (pRxBuffer->pOutPos <= pRxBuffer->pInPos) {
-		memcpy(pdata, pRxBuffer->pOutPos, len_tmp);
-		pRxBuffer->pOutPos += len_tmp;
-		pRxBuffer->Space += len_tmp;
-	}
-	else {
-		if (len_tmp > tail_len) {
-			memcpy(pdata, pRxBuffer->pOutPos, tail_len);
-			pRxBuffer->pOutPos += tail_len;
-			pRxBuffer->pOutPos = (pRxBuffer->pUartBuff +
-								  (pRxBuffer->pOutPos - pRxBuffer->pUartBuff) % pRxBuffer->UartBuffSize);
-			pRxBuffer->Space += tail_len;
-
-			memcpy(pdata + tail_len, pRxBuffer->pOutPos, len_tmp - tail_len);
-			pRxBuffer->pOutPos += (len_tmp - tail_len);
-			pRxBuffer->pOutPos = (pRxBuffer->pUartBuff +
-								  (pRxBuffer->pOutPos - pRxBuffer->pUartBuff) % pRxBuffer->UartBuffSize);
-			pRxBuffer->Space += (len_tmp - tail_len);
-		}
-		else {
-			//os_printf("case 3 in rx deq\n\r");
-			memcpy(pdata, pRxBuffer->pOutPos, len_tmp);
-			pRxBuffer->pOutPos += len_tmp;
-			pRxBuffer->pOutPos = (pRxBuffer->pUartBuff +
-								  (pRxBuffer->pOutPos - pRxBuffer->pUartBuff) % pRxBuffer->UartBuffSize);
-			pRxBuffer->Space += len_tmp;
-		}
-	}
-	// this maybe shouldnt be here??
-	if (pRxBuffer->Space >= UART_FIFO_LEN) {
-		uart_rx_intr_enable(UART0);
+	const char *src;
+	uint16 total = 0;
+
+	// at most two pieces, if the data wraps around
+	while (total < data_len) {
+		uint16 len = UART_RxPeek(&src);
+		if (len == 0) break;
+		if (len > data_len - total) len = (uint16) (data_len - total);
+		memcpy(pdata + total, src, len);
+		UART_RxCommit(len);
+		total += len;
 	}
-	return len_tmp;
+	return total;
 }
 
 //move data from uart fifo to rx buffer
@@ -173,10 +210,18 @@ void UART_RxFifoCollect(void)
 {
 	uint8 fifo_len, buf_idx;
 	uint8 fifo_data;
+
+	if (UART_RxFifoHeld()) {
+		// leave it in the FIFO until the buffer drains
+		return;
+	}
+
 	fifo_len = (uint8) ((READ_PERI_REG(UART_STATUS(UART0)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT);
-	if (fifo_len >= pRxBuffer->Space) {
-		fifo_len = (uint8) (pRxBuffer->Space - 1);
+	const uint16 space = ring_space(&rxBuffer);
+	if (fifo_len >= space) {
+		fifo_len = (uint8) (space - 1);
 		UART_WriteChar(UART1, '#', 10);
+		uart_stats.rx_dropped += fifo_len;
 		// discard contents of the FIFO - would loop forever
 		buf_idx = 0;
 		while (buf_idx < fifo_len) {
@@ -187,31 +232,36 @@ void UART_RxFifoCollect(void)
 		return;
 	}
 
-	buf_idx = 0;
-	while (buf_idx < fifo_len) {
-		buf_idx++;
-		fifo_data = (uint8) (READ_PERI_REG(UART_FIFO(UART0)) & 0xFF);
-		*(pRxBuffer->pInPos++) = fifo_data;
-		if (pRxBuffer->pInPos == (pRxBuffer->pUartBuff + pRxBuffer->UartBuffSize)) {
-			pRxBuffer->pInPos = pRxBuffer->pUartBuff;
-		}
+	uint16 head = rxBuffer.head;
+	for (buf_idx = 0; buf_idx < fifo_len; buf_idx++) {
+		rxBuffer.data[head++ & rxBuffer.mask] = (uint8) (READ_PERI_REG(UART_FIFO(UART0)) & 0xFF);
+	}
+
+	RING_BARRIER();
+	rxBuffer.head = head;
+
+	uart_stats.rx_bytes += fifo_len;
+	const uint16 count = ring_count(&rxBuffer);
+	if (count > uart_stats.rx_high_water) uart_stats.rx_high_water = count;
+
+	if (rx_flow != NONE_CTRL && !rx_throttled && count >= RX_HIGH_WATER) {
+		UART_RxThrottle(true);
 	}
-	pRxBuffer->Space -= fifo_len;
 //
 	// this is called by the processing routine, no need here
-//		if (pRxBuffer->Space >= UART_FIFO_LEN) {
+//		if (ring_space(&rxBuffer) >= UART_FIFO_LEN) {
 //			uart_rx_intr_enable(UART0);
 //		}
 }
 
 u16 ICACHE_FLASH_ATTR UART_AsyncTxGetEmptySpace(void)
 {
-	return pTxBuffer->Space;
+	return ring_space(&txBuffer);
 }
 
 u16 ICACHE_FLASH_ATTR UART_AsyncTxCount(void)
 {
-	return (u16) (pTxBuffer->UartBuffSize - pTxBuffer->Space);
+	return ring_count(&txBuffer);
 }
 
 /**
@@ -225,13 +275,17 @@ UART_SendAsync(const char *pdata, int data_len)
 	size_t real_len = (data_len) <= 0 ? strlen(pdata) : (size_t) data_len;
 
 	buf_dbg("Send Async %d", real_len);
-	if (real_len <= pTxBuffer->Space) {
-		buf_dbg("accepted, space %d", pTxBuffer->Space);
-		UART_WriteToAsyncBuffer(pTxBuffer, pdata, (uint16) real_len);
+	if (real_len <= ring_space(&txBuffer)) {
+		buf_dbg("accepted, space %d", ring_space(&txBuffer));
+		UART_WriteToAsyncBuffer(&txBuffer, pdata, (uint16) real_len);
+
+		const uint16 count = ring_count(&txBuffer);
+		if (count > uart_stats.tx_high_water) uart_stats.tx_high_water = count;
 	}
 	else {
 		buf_dbg("FULL!");
 		UART_WriteChar(UART1, '=', 10);
+		uart_stats.tx_dropped += real_len;
 	}
 
 	// Here we enable TX empty interrupt that will take care of sending the content
@@ -244,14 +298,15 @@ UART_SendAsync(const char *pdata, int data_len)
 static void UART_TxFifoEnq(struct UartBuffer *pTxBuff, uint8 data_len, uint8 uart_no)
 {
 	uint8 i;
+	uint16 tail = pTxBuff->tail;
 	for (i = 0; i < data_len; i++) {
-		WRITE_PERI_REG(UART_FIFO(uart_no), *(pTxBuff->pOutPos++));
-		if (pTxBuff->pOutPos == (pTxBuff->pUartBuff + pTxBuff->UartBuffSize)) {
-			pTxBuff->pOutPos = pTxBuff->pUartBuff;
-		}
+		WRITE_PERI_REG(UART_FIFO(uart_no), pTxBuff->data[tail++ & pTxBuff->mask]);
 	}
-	pTxBuff->pOutPos = (pTxBuff->pUartBuff + (pTxBuff->pOutPos - pTxBuff->pUartBuff) % pTxBuff->UartBuffSize);
-	pTxBuff->Space += data_len;
+
+	RING_BARRIER();
+	pTxBuff->tail = tail;
+
+	uart_stats.tx_bytes += data_len;
 }
 
 volatile bool next_empty_it_only_for_notify = false;
@@ -268,16 +323,16 @@ void UART_DispatchFromTxBuffer(uint8 uart_no)
 	uint8 len_tmp;
 	uint16 data_len;
 
-	data_len = (uint16) (pTxBuffer->UartBuffSize - pTxBuffer->Space);
+	data_len = ring_count(&txBuffer);
 	buf_dbg("rem %d",data_len);
 	if (data_len > fifo_remain) {
 		len_tmp = fifo_remain;
-		UART_TxFifoEnq(pTxBuffer, len_tmp, uart_no);
+		UART_TxFifoEnq(&txBuffer, len_tmp, uart_no);
 		SET_PERI_REG_MASK(UART_INT_ENA(UART0), UART_TXFIFO_EMPTY_INT_ENA);
 	}
 	else {
 		len_tmp = (uint8) data_len;
-		UART_TxFifoEnq(pTxBuffer, len_tmp, uart_no);
+		UART_TxFifoEnq(&txBuffer, len_tmp, uart_no);
 
 		// We get one more IT after fifo ends even if we have 0 more bytes,
 		// for notify. Otherwise we would say we have space while the FIFO
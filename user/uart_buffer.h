@@ -6,9 +6,10 @@
 #define ESP_VT100_FIRMWARE_UART_BUFFER_H
 
 #include <esp8266.h>
+#include "uart_driver.h"
 
-#define UART_TX_BUFFER_SIZE 1000 //Ring buffer length of tx buffer
-#define UART_RX_BUFFER_SIZE 600 //Ring buffer length of rx buffer
+#define UART_TX_BUFFER_SIZE 1024 //Ring buffer length of tx buffer, must be a power of two
+#define UART_RX_BUFFER_SIZE 1024 //Ring buffer length of rx buffer, must be a power of two
 
 // the init func
 void UART_AllocBuffers(void);
@@ -16,6 +17,11 @@ void UART_AllocBuffers(void);
 // read from rx buffer
 uint16 UART_ReadAsync(char *pdata, uint16 data_len);
 
+// get a contiguous span of the rx buffer without copying
+uint16 UART_RxPeek(const char **pdata);
+// release bytes obtained from UART_RxPeek
+void UART_RxCommit(uint16 data_len);
+
 // write to tx buffer
 void UART_SendAsync(const char *pdata, int data_len);
 
@@ -24,6 +30,25 @@ void UART_RxFifoCollect(void);
 //move data from uart tx buffer to fifo
 void UART_DispatchFromTxBuffer(uint8 uart_no);
 
+/** UART traffic counters, for sizing the buffers and baud rate */
+typedef struct {
+	u32 rx_bytes;       //!< bytes moved from the Rx FIFO to the buffer
+	u32 rx_dropped;     //!< bytes discarded because the Rx buffer was full
+	u32 tx_bytes;       //!< bytes moved from the Tx buffer to the FIFO
+	u32 tx_dropped;     //!< bytes not sent because the Tx buffer was full
+	u32 frame_errors;   //!< Rx framing errors
+	u32 fifo_overflows; //!< Rx FIFO overflows (data lost in hardware)
+	u32 rx_paused;      //!< times the peer was paused by flow control
+	u16 rx_high_water;  //!< most bytes held in the Rx buffer
+	u16 tx_high_water;  //!< most bytes held in the Tx buffer
+} UartStats;
+
+extern UartStats uart_stats;
+
+// rx flow control towards the peer
+void UART_SetRxFlowMode(UartFlowCtrl mode);
+bool UART_RxFifoHeld(void);
+
 u16 UART_AsyncRxCount(void);
 u16 UART_AsyncTxCount(void);
 
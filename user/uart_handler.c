@@ -24,8 +24,15 @@ static void uart_recvTask(os_event_t *events);
 static void uart_processTask(os_event_t *events);
 
 // Those heavily affect the byte loss ratio
-#define PROCESS_CHUNK_LEN 10
 #define RX_FIFO_FULL_THRES 40
+// With hardware flow control, RTS is deasserted when the FIFO fills past this.
+// Must be above RX_FIFO_FULL_THRES, so that it only kicks in when the FIFO is held.
+#define RX_FLOW_THRES 100
+// Bytes handed to the parser at once
+#define PROCESS_CHUNK_LEN 64
+// The process task drains the Rx buffer until this time runs out (us),
+// then yields, so the Rx task can move the FIFO to the buffer before it overflows
+#define PROCESS_TIME_BUDGET_US 1000
 
 #define uart_recvTaskPrio        1
 #define uart_recvTaskQueueLen    25
@@ -99,6 +106,18 @@ void ICACHE_FLASH_ATTR UART_SetupAsyncReceiver(void)
 }
 
 
+/**
+ * Configure flow control on UART0 (towards the peer, for Rx)
+ *
+ * @param mode - flow control mode
+ */
+void ICACHE_FLASH_ATTR UART_SetupFlowControl(UartFlowCtrl mode)
+{
+	// CTS is left alone, an unconnected pin would block our Tx
+	UART_SetFlowCtrl(UART0, (mode == HARDWARE_CTRL) ? USART_HWFlow_RTS : USART_HWFlow_None, RX_FLOW_THRES);
+	UART_SetRxFlowMode(mode);
+}
+
 // ---- async receive stuff ----
 
 
@@ -131,8 +150,10 @@ uart_recvTask(os_event_t *events)
 
 		// clear irq flags
 		WRITE_PERI_REG(UART_INT_CLR(UART0), UART_RXFIFO_FULL_INT_CLR | UART_RXFIFO_TOUT_INT_CLR);
-		// enable rx irq again
-		uart_rx_intr_enable(UART0);
+		// enable rx irq again, unless holding the data in the FIFO for flow control
+		if (!UART_RxFifoHeld()) {
+			uart_rx_intr_enable(UART0);
+		}
 
 		// Trigger the Reading task
 		system_os_post(uart_processTaskPrio, 5, 0);
@@ -164,13 +185,17 @@ uart_recvTask(os_event_t *events)
 static void ICACHE_FLASH_ATTR
 uart_processTask(os_event_t *events)
 {
-	static char buf[PROCESS_CHUNK_LEN];
-
 	if (events->sig == 5) {
-		// Send a few to the parser...
-		int bytes = UART_ReadAsync(buf, PROCESS_CHUNK_LEN);
-		for (uint8 idx = 0; idx < bytes; idx++) {
-			UART_HandleRxByte(buf[idx]);
+		// Feed the parser in chunks straight from the ring buffer,
+		// until the buffer is drained or the time is up
+		u32 start = system_get_time();
+		const char *data;
+		uint16 bytes;
+		while ((bytes = UART_RxPeek(&data)) > 0) {
+			if (bytes > PROCESS_CHUNK_LEN) bytes = PROCESS_CHUNK_LEN;
+			UART_HandleRxData(data, bytes);
+			UART_RxCommit(bytes);
+			if ((system_get_time() - start) >= PROCESS_TIME_BUDGET_US) break;
 		}
 
 		// ask for another run
@@ -198,6 +223,7 @@ uart0_rx_intr_handler(void *para)
 	if (status_reg & UART_FRM_ERR_INT_ST) {
 		// Framing Error
 		WRITE_PERI_REG(UART_INT_CLR(UART0), UART_FRM_ERR_INT_CLR);
+		uart_stats.frame_errors++;
 	}
 
 	if (status_reg & UART_RXFIFO_FULL_INT_ST) {
@@ -229,5 +255,6 @@ uart0_rx_intr_handler(void *para)
 
 		// overflow error
 		UART_WriteChar(UART1, '!', 100);
+		uart_stats.fifo_overflows++;
 	}
 }
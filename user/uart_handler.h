@@ -2,7 +2,7 @@
  * UART init & async rx module.
  *
  * Call UART_Init(), UART_SetupAsyncReceiver() and
- * define UART_HandleRxByte() somewhere in application code.
+ * define UART_HandleRxData() somewhere in application code.
  *
  * Call UART_PollRx() to allow rx in a blocking handler.
  */
@@ -11,6 +11,7 @@
 #define UART_HANDLER_H
 
 #include <esp8266.h>
+#include "uart_driver.h"
 
 /** Configure UART periphs and enable pins - does not set baud rate, parity and stopbits */
 void UART_Init(void);
@@ -18,8 +19,11 @@ void UART_Init(void);
 /** Configure async Rx on UART0 */
 void UART_SetupAsyncReceiver(void);
 
+/** Configure Rx flow control on UART0 */
+void UART_SetupFlowControl(UartFlowCtrl mode);
+
 /** User must provide this func for handling received bytes */
-extern void UART_HandleRxByte(char c);
+extern void UART_HandleRxData(const char *buf, size_t len);
 
 static inline void uart_rx_intr_disable(uint8 uart_no)
 {
@@ -31,6 +31,8 @@
 #include "ansi_parser.h"
 #include "ascii.h"
 #include "uart_buffer.h"
+#include "utf8.h"
+#include "cgi_sockets.h"
 
 #ifdef ESPFS_POS
 CgiUploadFlashDef uploadParams={
@@ -53,6 +55,26 @@ CgiUploadFlashDef uploadParams={
 #endif
 
 #define HEAP_TIMER_MS 1000
+/** Show the screen update rate and latency since the last call */
+static void ICACHE_FLASH_ATTR prFrameStats(void)
+{
+	static u32 last_time = 0;
+	static NotifyStats last; // the counters run since boot, for the stats API
+
+	u32 now = system_get_time();
+	u32 elapsed = (now - last_time) / 1000;
+	last_time = now;
+
+	u32 frames = notify_stats.frames - last.frames;
+	if (frames > 0 && elapsed > 0) {
+		dbg("Frames: %d in %d ms (%d/s), %d bytes, latency avg %d max %d ms, forced %d, postponed %d",
+			frames, elapsed, (frames * 1000) / elapsed, notify_stats.bytes - last.bytes,
+			(notify_stats.latency_sum - last.latency_sum) / frames, notify_stats.latency_max,
+			notify_stats.forced - last.forced, notify_stats.postponed - last.postponed);
+	}
+	last = notify_stats;
+}
+
 /** Periodically show heap usage */
 static void ICACHE_FLASH_ATTR prHeapTimerCb(void *arg)
 {
@@ -75,6 +97,10 @@ static void ICACHE_FLASH_ATTR prHeapTimerCb(void *arg)
 		if (cnt == 5) {
 			// only every 5 secs if no change
 			dbg("Rx/Tx: %d/%d%c, Hp: %d", rxp, txp, '%', heap);
+			dbg("Utf8 cache: %d/%d used, hit %d, miss %d, full %d",
+				unicode_cache_stats.used, UNICODE_CACHE_SIZE,
+				unicode_cache_stats.hits, unicode_cache_stats.misses, unicode_cache_stats.full);
+			prFrameStats();
 			cnt = 0;
 		}
 	} else {
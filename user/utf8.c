@@ -12,9 +12,61 @@ typedef struct __attribute__((packed)) {
 
 static UnicodeCacheSlot cache[UNICODE_CACHE_SIZE];
 
-#define REF_TO_ID(c) (u8)((c) >= 127 ? (c) - 95 : (c))
+/**
+ * Hash index - open addressing with linear probing.
+ * Holds slot number + 1 of the used slots, 0 marks an empty bucket.
+ */
+#define UNICODE_INDEX_SIZE (1 << UNICODE_INDEX_BITS)
+#define UNICODE_INDEX_MASK (UNICODE_INDEX_SIZE - 1)
+static UnicodeCacheId cache_index[UNICODE_INDEX_SIZE];
+
+/** Stack of free slots */
+static UnicodeCacheId free_slots[UNICODE_CACHE_SIZE];
+static int free_count = -1; // -1 = not initialized yet
+
+UnicodeCacheStats unicode_cache_stats;
+
+#define REF_TO_ID(c) UNICODE_CACHE_REF_INDEX(c)
 #define ID_TO_REF(c) (UnicodeCacheRef)((c) > 31 ? (c) + 95 : c)
 
+/**
+ * Get index bucket for the symbol bytes
+ * @param key - 4 bytes, zero padded
+ */
+static inline u32 ICACHE_FLASH_ATTR
+index_hash(const char *key)
+{
+	u32 word;
+	memcpy(&word, key, 4);
+	return (word * 2654435761u) >> (32 - UNICODE_INDEX_BITS);
+}
+
+/**
+ * Remove a slot from the hash index, shifting back the entries that follow it
+ */
+static void ICACHE_FLASH_ATTR
+index_remove(UnicodeCacheId slot)
+{
+	u32 i = index_hash(cache[slot].bytes);
+	while (cache_index[i] != slot + 1) {
+		if (cache_index[i] == 0) return; // not indexed
+		i = (i + 1) & UNICODE_INDEX_MASK;
+	}
+
+	u32 j = i;
+	while (1) {
+		j = (j + 1) & UNICODE_INDEX_MASK;
+		if (cache_index[j] == 0) break;
+		u32 k = index_hash(cache[cache_index[j] - 1].bytes);
+		// move the entry to the gap if its home bucket is not between the gap and its position
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			cache_index[i] = cache_index[j];
+			i = j;
+		}
+	}
+	cache_index[i] = 0;
+}
+
 /**
  * Clear the entire cache
  * @return
@@ -25,7 +77,12 @@ unicode_cache_clear(void)
 	utfc_dbg("utf8 cache clear!");
 	for (int slot = 0; slot < UNICODE_CACHE_SIZE; slot++) {
 		cache[slot].count=0;
+		// lowest slots are taken first
+		free_slots[slot] = (UnicodeCacheId) (UNICODE_CACHE_SIZE - 1 - slot);
 	}
+	free_count = UNICODE_CACHE_SIZE;
+	memset(cache_index, 0, sizeof(cache_index));
+	unicode_cache_stats.used = 0;
 }
 
 /**
@@ -44,29 +101,39 @@ unicode_cache_add(const u8 *bytes)
 	}
 	if (bytes[0] < 127) return bytes[0]; // ASCII, bypass
 
-	u8 slot;
-	for (slot = 0; slot < UNICODE_CACHE_SIZE; slot++) {
-		if (strneq(cache[slot].bytes, bytes, 4)) {
+	if (free_count < 0) unicode_cache_clear();
+
+	char key[4];
+	strncpy(key, (const char *) bytes, 4); // this will zero out the remainder
+
+	UnicodeCacheId slot;
+	u32 i = index_hash(key);
+	while (cache_index[i] != 0) {
+		slot = (UnicodeCacheId) (cache_index[i] - 1);
+		if (memcmp(cache[slot].bytes, key, 4) == 0) {
 			cache[slot].count++;
-			if (cache[slot].count == 1) {
-				utfc_dbg("utf8 cache new '%.4s' @ %d", bytes, slot);
-			} else {
-				utfc_dbg("utf8 cache inc '%.4s' @ %d, %d uses", bytes, slot, cache[slot].count);
-			}
+			unicode_cache_stats.hits++;
+			utfc_dbg("utf8 cache inc '%.4s' @ %d, %d uses", bytes, slot, cache[slot].count);
 			goto suc;
 		}
+		i = (i + 1) & UNICODE_INDEX_MASK;
 	}
-	for (slot = 0; slot < UNICODE_CACHE_SIZE; slot++) {
-		if (cache[slot].count==0) {
-			// empty slot, store it
-			strncpy(cache[slot].bytes, (const char *) bytes, 4); // this will zero out the remainder
-			cache[slot].count = 1;
-			utfc_dbg("utf8 cache new '%.4s' @ %d", bytes, slot);
-			goto suc;
-		}
+
+	if (free_count == 0) {
+		unicode_cache_stats.full++;
+		error("utf8 cache full");
+		return '?'; // fallback to normal ASCII that will show to the user
 	}
-	error("utf8 cache full");
-	return '?'; // fallback to normal ASCII that will show to the user
+
+	// empty slot, store it
+	slot = free_slots[--free_count];
+	memcpy(cache[slot].bytes, key, 4);
+	cache[slot].count = 1;
+	cache_index[i] = (UnicodeCacheId) (slot + 1);
+	unicode_cache_stats.misses++;
+	unicode_cache_stats.used++;
+	utfc_dbg("utf8 cache new '%.4s' @ %d", bytes, slot);
+
 	suc:
 	return ID_TO_REF(slot);
 }
@@ -109,7 +176,7 @@ unicode_cache_retrieve(UnicodeCacheRef ref, u8 *target)
 		return true;
 	}
 
-	u8 slot = REF_TO_ID(ref);
+	UnicodeCacheId slot = REF_TO_ID(ref);
 	if (cache[slot].count == 0) {
 		// "use after free"
 		target[0] = '?';
@@ -135,7 +202,7 @@ unicode_cache_remove(UnicodeCacheRef ref)
 {
 	if (!IS_UNICODE_CACHE_REF(ref)) return true; // ASCII, bypass
 
-	u8 slot = REF_TO_ID(ref);
+	UnicodeCacheId slot = REF_TO_ID(ref);
 
 	if (cache[slot].count == 0) {
 		utfc_warn("utf8 cache double-free @ %d ('%.4s')", slot, cache[slot].bytes);
@@ -147,6 +214,9 @@ unicode_cache_remove(UnicodeCacheRef ref)
 		utfc_dbg("utf8 cache sub '%.4s' @ %d, %d uses remain", cache[slot].bytes, slot, cache[slot].count);
 	} else {
 		utfc_dbg("utf8 cache del '%.4s' @ %d", cache[slot].bytes, slot);
+		index_remove(slot);
+		free_slots[free_count++] = slot;
+		unicode_cache_stats.used--;
 	}
 	return true;
 }
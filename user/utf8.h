@@ -7,11 +7,62 @@
 
 #include <c_types.h>
 
+/**
+ * Wide references - screen cells use 16 bits for the symbol, so the cache
+ * can hold thousands of code points. Costs one extra byte per screen cell.
+ * The cache size (UNICODE_CACHE_SIZE) and index size (UNICODE_INDEX_BITS)
+ * can be overridden from the Makefile to fit the memory budget.
+ */
+#ifndef UNICODE_CACHE_WIDE
+#define UNICODE_CACHE_WIDE 0
+#endif
+
+#if UNICODE_CACHE_WIDE
+typedef u16 UnicodeCacheRef;
+typedef u16 UnicodeCacheId;
+
+#ifndef UNICODE_CACHE_SIZE
+#define UNICODE_CACHE_SIZE 1024
+#endif
+#ifndef UNICODE_INDEX_BITS
+#define UNICODE_INDEX_BITS 11
+#endif
+
+#if UNICODE_CACHE_SIZE > 65535-95
+#error "UNICODE_CACHE_SIZE too large"
+#endif
+#else
+typedef u8 UnicodeCacheRef;
+typedef u8 UnicodeCacheId;
+
 // 160 is maximum possible
+#ifndef UNICODE_CACHE_SIZE
 #define UNICODE_CACHE_SIZE 160
+#endif
+#define UNICODE_INDEX_BITS 8
+
+#if UNICODE_CACHE_SIZE > 160
+#error "UNICODE_CACHE_SIZE too large, use UNICODE_CACHE_WIDE"
+#endif
+#endif
+
+#if UNICODE_CACHE_SIZE >= (1 << UNICODE_INDEX_BITS)
+#error "UNICODE_INDEX_BITS too small for the cache size"
+#endif
 
-typedef u8 UnicodeCacheRef;
 #define IS_UNICODE_CACHE_REF(c) ((c) < 32 || (c) >= 127)
+/** Slot index of a cache reference, 0 .. UNICODE_CACHE_SIZE-1 */
+#define UNICODE_CACHE_REF_INDEX(c) (UnicodeCacheId)((c) >= 127 ? (c) - 95 : (c))
+
+/** Unicode cache counters, for tuning the cache size */
+typedef struct {
+	u32 hits;   //!< code point was found in the cache
+	u32 misses; //!< code point was stored in a new slot
+	u32 full;   //!< no free slot, '?' was used instead
+	u16 used;   //!< currently used slots
+} UnicodeCacheStats;
+
+extern UnicodeCacheStats unicode_cache_stats;
 
 /**
  * Clear the entire cache